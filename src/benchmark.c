@@ -0,0 +1,180 @@
+#ifdef TIMESTYLE_BENCHMARK
+
+// this file needs the real draw functions, not the counting wrappers
+#define BENCHMARK_NO_WRAP
+
+#include <pebble.h>
+#include "settings.h"
+#include "clock_digit.h"
+#include "util.h"
+#include "sidebar_widgets/sidebar_widgets.h"
+#include "benchmark.h"
+
+// every widget type, in both font sizes, with and without compact mode
+#define STEP_COUNT (SIDEBAR_WIDGET_TYPE_COUNT * 4)
+
+// give the watch some time to settle before starting, and between steps
+#define START_DELAY_MS 2000
+#define STEP_DELAY_MS 100
+
+// y position that the widgets are drawn at, same as the top sidebar slot
+#define WIDGET_POSITION 8
+
+typedef struct {
+  uint32_t text;
+  uint32_t rect;
+  uint32_t radial;
+  uint32_t image;
+  uint32_t recolor;
+} DrawCounts;
+
+Layer* Benchmark_layer;
+void (*Benchmark_finishedCallback)(void);
+int Benchmark_currentStep;
+bool Benchmark_stepPending;
+DrawCounts Benchmark_counts;
+
+void Benchmark_timerCallback(void* context);
+void Benchmark_runClockDigits();
+
+void Benchmark_start(Layer* rootLayer, void (*finished_callback)(void)) {
+  Benchmark_layer = rootLayer;
+  Benchmark_finishedCallback = finished_callback;
+  Benchmark_currentStep = 0;
+  Benchmark_stepPending = false;
+
+  APP_LOG(APP_LOG_LEVEL_INFO, "Benchmark: starting, %d iterations per step", BENCHMARK_ITERATIONS);
+
+  app_timer_register(START_DELAY_MS, Benchmark_timerCallback, NULL);
+}
+
+void Benchmark_timerCallback(void* context) {
+  if(Benchmark_currentStep < STEP_COUNT) {
+    // the next step runs the next time the sidebar is drawn
+    Benchmark_stepPending = true;
+    layer_mark_dirty(Benchmark_layer);
+  } else {
+    Benchmark_runClockDigits();
+
+    APP_LOG(APP_LOG_LEVEL_INFO, "Benchmark: done");
+
+    // put everything back the way it was
+    Benchmark_finishedCallback();
+  }
+}
+
+void Benchmark_drawStep(GContext* ctx) {
+  if(!Benchmark_stepPending) {
+    return;
+  }
+
+  Benchmark_stepPending = false;
+
+  SidebarWidgetType type = Benchmark_currentStep / 4;
+  bool largeFonts = Benchmark_currentStep & 1;
+  bool compactMode = Benchmark_currentStep & 2;
+
+  // switch to the settings for this step
+  bool savedLargeFonts = globalSettings.useLargeFonts;
+  bool savedCompactMode = SidebarWidgets_useCompactMode;
+  SidebarWidgetType savedWidget = globalSettings.widgets[0];
+
+  globalSettings.useLargeFonts = largeFonts;
+  SidebarWidgets_updateFonts();
+  SidebarWidgets_useCompactMode = compactMode;
+
+  // make sure the icons for the widget under test are loaded
+  globalSettings.widgets[0] = type;
+  SidebarWidgets_updateLoadedIcons();
+
+  const SidebarWidget* widget = getSidebarWidgetByType(type);
+
+  memset(&Benchmark_counts, 0, sizeof(DrawCounts));
+  int heapBefore = heap_bytes_free();
+  uint32_t startTime = time_get_ms();
+
+  for(int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+    widget->draw(ctx, WIDGET_POSITION);
+  }
+
+  uint32_t elapsed = time_get_ms() - startTime;
+  int heapGrowth = heapBefore - (int)heap_bytes_free();
+
+  APP_LOG(APP_LOG_LEVEL_INFO,
+          "Benchmark: widget %d large %d compact %d: %d us/frame, per frame: %d text %d rect %d radial %d pdc %d recolor, heap +%d",
+          (int)type, largeFonts, compactMode,
+          (int)(elapsed * 1000 / BENCHMARK_ITERATIONS),
+          (int)(Benchmark_counts.text / BENCHMARK_ITERATIONS),
+          (int)(Benchmark_counts.rect / BENCHMARK_ITERATIONS),
+          (int)(Benchmark_counts.radial / BENCHMARK_ITERATIONS),
+          (int)(Benchmark_counts.image / BENCHMARK_ITERATIONS),
+          (int)(Benchmark_counts.recolor / BENCHMARK_ITERATIONS),
+          heapGrowth);
+
+  // restore the real settings
+  globalSettings.useLargeFonts = savedLargeFonts;
+  SidebarWidgets_updateFonts();
+  SidebarWidgets_useCompactMode = savedCompactMode;
+  globalSettings.widgets[0] = savedWidget;
+  SidebarWidgets_updateLoadedIcons();
+
+  Benchmark_currentStep++;
+  app_timer_register(STEP_DELAY_MS, Benchmark_timerCallback, NULL);
+}
+
+/*
+ * Measures how long it takes to change a clock digit, for each font
+ */
+void Benchmark_runClockDigits() {
+  ClockDigit digit;
+  ClockDigit_construct(&digit, GPoint(0, 0));
+
+  for(int fontId = FONT_SETTING_DEFAULT; fontId <= FONT_SETTING_BOLD; fontId++) {
+    ClockDigit_setActiveFonts(1 << fontId);
+
+    int heapBefore = heap_bytes_free();
+    uint32_t startTime = time_get_ms();
+
+    for(int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+      ClockDigit_setNumber(&digit, i % 10, fontId);
+    }
+
+    uint32_t elapsed = time_get_ms() - startTime;
+
+    APP_LOG(APP_LOG_LEVEL_INFO, "Benchmark: clock digit font %d: %d us/change, heap +%d",
+            fontId, (int)(elapsed * 1000 / BENCHMARK_ITERATIONS), heapBefore - (int)heap_bytes_free());
+  }
+
+  ClockDigit_destruct(&digit);
+}
+
+/********** counting wrappers **********/
+
+void Benchmark_drawText(GContext* ctx, const char* text, GFont font, GRect box,
+                        GTextOverflowMode overflow, GTextAlignment alignment, GTextAttributes* attributes) {
+  Benchmark_counts.text++;
+  graphics_draw_text(ctx, text, font, box, overflow, alignment, attributes);
+}
+
+void Benchmark_fillRect(GContext* ctx, GRect rect, uint16_t cornerRadius, GCornerMask cornerMask) {
+  Benchmark_counts.rect++;
+  graphics_fill_rect(ctx, rect, cornerRadius, cornerMask);
+}
+
+void Benchmark_fillRadial(GContext* ctx, GRect rect, GOvalScaleMode scaleMode, uint16_t insetThickness,
+                          int32_t angleStart, int32_t angleEnd) {
+  Benchmark_counts.radial++;
+  graphics_fill_radial(ctx, rect, scaleMode, insetThickness, angleStart, angleEnd);
+}
+
+void Benchmark_drawCommandImage(GContext* ctx, GDrawCommandImage* image, GPoint offset) {
+  Benchmark_counts.image++;
+  gdraw_command_image_draw(ctx, image, offset);
+}
+
+void Benchmark_recolor(GDrawCommandImage* img, GColor fill_color, GColor stroke_color) {
+  Benchmark_counts.recolor++;
+  gdraw_command_image_recolor(img, fill_color, stroke_color);
+}
+
+#endif
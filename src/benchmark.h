@@ -0,0 +1,47 @@
+#pragma once
+#include <pebble.h>
+
+/*
+ * Render benchmark, only compiled in when building with TIMESTYLE_BENCHMARK=1
+ * in the environment (see wscript). It runs on the watch or the emulator, so
+ * that the numbers come from the real graphics stack.
+ *
+ * Every widget is drawn BENCHMARK_ITERATIONS times for each combination of
+ * font size and compact mode, one combination per frame, and the results are
+ * written to the app log: time per frame, draw primitives per frame and heap
+ * growth. The clock digit swap path is measured the same way.
+ */
+#ifdef TIMESTYLE_BENCHMARK
+
+#define BENCHMARK_ITERATIONS 500
+
+/*
+ * Starts the benchmark. rootLayer is marked dirty to run each step, and
+ * finished_callback is called once everything has been measured
+ */
+void Benchmark_start(Layer* rootLayer, void (*finished_callback)(void));
+
+/*
+ * Called from the sidebar update proc. If a benchmark step is pending, runs it
+ * into the provided context (the normal sidebar is drawn over it afterwards)
+ */
+void Benchmark_drawStep(GContext* ctx);
+
+// counting wrappers for the draw primitives used by the sidebar
+void Benchmark_drawText(GContext* ctx, const char* text, GFont font, GRect box,
+                        GTextOverflowMode overflow, GTextAlignment alignment, GTextAttributes* attributes);
+void Benchmark_fillRect(GContext* ctx, GRect rect, uint16_t cornerRadius, GCornerMask cornerMask);
+void Benchmark_fillRadial(GContext* ctx, GRect rect, GOvalScaleMode scaleMode, uint16_t insetThickness,
+                          int32_t angleStart, int32_t angleEnd);
+void Benchmark_drawCommandImage(GContext* ctx, GDrawCommandImage* image, GPoint offset);
+void Benchmark_recolor(GDrawCommandImage* img, GColor fill_color, GColor stroke_color);
+
+#ifndef BENCHMARK_NO_WRAP
+  #define graphics_draw_text(...)          Benchmark_drawText(__VA_ARGS__)
+  #define graphics_fill_rect(...)          Benchmark_fillRect(__VA_ARGS__)
+  #define graphics_fill_radial(...)        Benchmark_fillRadial(__VA_ARGS__)
+  #define gdraw_command_image_draw(...)    Benchmark_drawCommandImage(__VA_ARGS__)
+  #define gdraw_command_image_recolor(...) Benchmark_recolor(__VA_ARGS__)
+#endif
+
+#endif
@@ -1,7 +1,46 @@
 #include <pebble.h>
 #include "clock_digit.h"
+#include "telemetry.h"
 
-void adjustImagePalette(ClockDigit* this);
+void usePalette(GBitmap* image, int fontId);
+GBitmap* getDigitImage(int number, int fontId);
+void releaseImage(ClockDigit* this);
+
+/*
+ * The digit atlas keeps all ten images of each active font resident, so that
+ * changing a digit is just a pointer swap. Aplite doesn't have the RAM to
+ * spare, so there we fall back to loading each digit image when it changes.
+ */
+#ifdef PBL_PLATFORM_APLITE
+  #define ATLAS_ENABLED false
+#else
+  #define ATLAS_ENABLED true
+#endif
+
+// if loading an atlas would leave less than this much heap, don't use it
+#define ATLAS_MIN_FREE_HEAP 4096
+
+#define ATLAS_FONT_COUNT 3
+
+GBitmap* ClockDigit_atlas[ATLAS_FONT_COUNT][10];
+bool ClockDigit_atlasAvailable = ATLAS_ENABLED;
+
+// bumped whenever atlas images are loaded or freed, so that digits holding
+// a pointer into a stale atlas know to pick up the new image
+uint8_t ClockDigit_atlasGeneration = 0;
+
+/*
+ * The palettes shared by every digit image. The 2 bit fonts get the
+ * antialiasing shades in between the foreground and background colors.
+ */
+#ifdef PBL_COLOR
+  GColor ClockDigit_palette2Bit[4]; // fg, two antialiasing shades, bg
+#endif
+GColor ClockDigit_palette1Bit[2]; // fg, bg
+
+GColor ClockDigit_paletteFgColor;
+GColor ClockDigit_paletteBgColor;
+bool ClockDigit_paletteSet = false;
 
 /*
  * Array mapping numbers to resource ids
@@ -40,20 +79,36 @@ uint32_t ClockDigit_imageIds[3][10] = {
 };
 
 void ClockDigit_setNumber(ClockDigit* this, int number, int fontId) {
+  GBitmap* atlasImage = getDigitImage(number, fontId);
+
+  if(atlasImage) {
+    // the atlas owns the image, so all we need to do is swap pointers
+    if(this->currentImage != atlasImage || this->atlasGeneration != ClockDigit_atlasGeneration) {
+      releaseImage(this);
+
+      this->currentImage = atlasImage;
+      this->currentImageId = ClockDigit_imageIds[fontId][number];
+      this->currentNum = number;
+      this->currentFontId = fontId;
+      this->imageFromAtlas = true;
+      this->atlasGeneration = ClockDigit_atlasGeneration;
 
-  if(this->currentNum != number || this->currentFontId != fontId) {
+      bitmap_layer_set_bitmap(this->imageLayer, this->currentImage);
+    }
+  } else if(this->currentNum != number || this->currentFontId != fontId || this->imageFromAtlas) {
 
     //deallocate the old bg image
-    gbitmap_destroy(this->currentImage);
+    releaseImage(this);
 
     //change over to the new digit image
     this->currentImageId = ClockDigit_imageIds[fontId][number];
     this->currentImage = gbitmap_create_with_resource(this->currentImageId);
+    Telemetry_countResourceLoad();
     this->currentNum = number;
     this->currentFontId = fontId;
 
-    //set the palette properly
-    adjustImagePalette(this);
+    //point the image at the shared palette
+    usePalette(this->currentImage, fontId);
 
     //set the layer to the new image
     bitmap_layer_set_bitmap(this->imageLayer, this->currentImage);
@@ -72,10 +127,21 @@ void ClockDigit_offsetPosition(ClockDigit* this, int posOffset) {
                   GRect(this->position.x + posOffset, this->position.y, 48, 71));
 }
 
-void ClockDigit_setColor(ClockDigit* this, GColor fg, GColor bg) {
-  // set the new colors
-  this->fgColor = fg;
-  this->bgColor = bg;
+void ClockDigit_setColors(GColor fg, GColor bg) {
+  // the images already point at the palettes, so if the colors are the same
+  // there's nothing to do
+  if(ClockDigit_paletteSet &&
+     gcolor_equal(fg, ClockDigit_paletteFgColor) &&
+     gcolor_equal(bg, ClockDigit_paletteBgColor)) {
+    return;
+  }
+
+  ClockDigit_paletteFgColor = fg;
+  ClockDigit_paletteBgColor = bg;
+  ClockDigit_paletteSet = true;
+
+  ClockDigit_palette1Bit[0] = fg;
+  ClockDigit_palette1Bit[1] = bg;
 
   // now, determine what the intermediate colors will be (for AA)
   #ifdef PBL_COLOR
@@ -83,30 +149,27 @@ void ClockDigit_setColor(ClockDigit* this, GColor fg, GColor bg) {
     int colorIncrementG = (fg.g * 85 - bg.g * 85) / 3;
     int colorIncrementB = (fg.b * 85 - bg.b * 85) / 3;
 
-    this->midColor1 = GColorFromRGB(fg.r * 85 - colorIncrementR,
-                                     fg.g * 85 - colorIncrementG,
-                                     fg.b * 85 - colorIncrementB);
-
-    this->midColor2 = GColorFromRGB(bg.r * 85 + colorIncrementR,
-                                     bg.g * 85 + colorIncrementG,
-                                     bg.b * 85 + colorIncrementB);
-
+    ClockDigit_palette2Bit[0] = fg;
+    ClockDigit_palette2Bit[1] = GColorFromRGB(fg.r * 85 - colorIncrementR,
+                                              fg.g * 85 - colorIncrementG,
+                                              fg.b * 85 - colorIncrementB);
+    ClockDigit_palette2Bit[2] = GColorFromRGB(bg.r * 85 + colorIncrementR,
+                                              bg.g * 85 + colorIncrementG,
+                                              bg.b * 85 + colorIncrementB);
+    ClockDigit_palette2Bit[3] = bg;
   #endif
-
-  adjustImagePalette(this);
 }
 
 void ClockDigit_construct(ClockDigit* this, GPoint pos) {
   this->currentNum = -1;
-  this->bgColor = GColorWhite;
-  this->fgColor = GColorBlack;
+  this->currentImage = NULL;
+  this->imageFromAtlas = false;
   this->position = pos;
 
   this->imageLayer = bitmap_layer_create(GRect(pos.x, pos.y, 48, 71));
 
   ClockDigit_setBlank(this);
   ClockDigit_setNumber(this, 1, 0);
-  ClockDigit_setColor(this, GColorBlack, GColorWhite);
 }
 
 void ClockDigit_destruct(ClockDigit* this) {
@@ -114,26 +177,95 @@ void ClockDigit_destruct(ClockDigit* this) {
   bitmap_layer_destroy(this->imageLayer);
 
   // deallocate the background image
-  gbitmap_destroy(this->currentImage);
+  releaseImage(this);
+}
+
+void ClockDigit_setActiveFonts(uint8_t fontMask) {
+  if(!ClockDigit_atlasAvailable) {
+    return;
+  }
+
+  for(int fontId = 0; fontId < ATLAS_FONT_COUNT; fontId++) {
+    bool needed = fontMask & (1 << fontId);
+
+    if(needed && !ClockDigit_atlas[fontId][0]) {
+      for(int i = 0; i < 10; i++) {
+        ClockDigit_atlas[fontId][i] = gbitmap_create_with_resource(ClockDigit_imageIds[fontId][i]);
+        usePalette(ClockDigit_atlas[fontId][i], fontId);
+        Telemetry_countResourceLoad();
+      }
+
+      ClockDigit_atlasGeneration++;
+
+      // not enough RAM left over? go back to loading digits on demand
+      if(!ClockDigit_atlas[fontId][9] || heap_bytes_free() < ATLAS_MIN_FREE_HEAP) {
+        APP_LOG(APP_LOG_LEVEL_WARNING, "Not enough memory for the digit atlas, loading digits lazily");
+        ClockDigit_atlasAvailable = false;
+      }
+    } else if(!needed && ClockDigit_atlas[fontId][0]) {
+      for(int i = 0; i < 10; i++) {
+        gbitmap_destroy(ClockDigit_atlas[fontId][i]);
+        ClockDigit_atlas[fontId][i] = NULL;
+      }
+
+      ClockDigit_atlasGeneration++;
+    }
+  }
+
+  if(!ClockDigit_atlasAvailable) {
+    ClockDigit_freeAtlas();
+  }
+}
+
+void ClockDigit_freeAtlas() {
+  for(int fontId = 0; fontId < ATLAS_FONT_COUNT; fontId++) {
+    for(int i = 0; i < 10; i++) {
+      gbitmap_destroy(ClockDigit_atlas[fontId][i]);
+      ClockDigit_atlas[fontId][i] = NULL;
+    }
+  }
+
+  ClockDigit_atlasGeneration++;
 }
 
-void adjustImagePalette(ClockDigit* this) {
-  if(this->currentImage) {
-    GColor* pal = gbitmap_get_palette(this->currentImage);
+/*
+ * Returns the atlas image for the specified digit, or NULL if that digit
+ * isn't in the atlas
+ */
+GBitmap* getDigitImage(int number, int fontId) {
+  if(number < 0 || number > 9 || fontId < 0 || fontId >= ATLAS_FONT_COUNT) {
+    return NULL;
+  }
+
+  return ClockDigit_atlas[fontId][number];
+}
 
+/*
+ * Points the image at the shared palette for its font, replacing (and
+ * freeing) the one it was loaded with
+ */
+void usePalette(GBitmap* image, int fontId) {
+  if(image) {
     #ifdef PBL_COLOR
-      if(this->currentFontId == FONT_SETTING_DEFAULT || this->currentFontId == FONT_SETTING_BOLD) {
-        pal[0] = this->fgColor;
-        pal[1] = this->midColor1;
-        pal[2] = this->midColor2;
-        pal[3] = this->bgColor;
+      if(fontId == FONT_SETTING_DEFAULT || fontId == FONT_SETTING_BOLD) {
+        gbitmap_set_palette(image, ClockDigit_palette2Bit, false);
       } else { // LECO only has two colors
-        pal[0] = this->fgColor;
-        pal[1] = this->bgColor;
+        gbitmap_set_palette(image, ClockDigit_palette1Bit, false);
       }
     #else
-      pal[0] = this->fgColor;
-      pal[1] = this->bgColor;
+      gbitmap_set_palette(image, ClockDigit_palette1Bit, false);
     #endif
   }
 }
+
+/*
+ * Frees the digit's current image, unless it belongs to the atlas
+ */
+void releaseImage(ClockDigit* this) {
+  if(!this->imageFromAtlas) {
+    gbitmap_destroy(this->currentImage);
+  }
+
+  this->currentImage = NULL;
+  this->imageFromAtlas = false;
+}
@@ -13,14 +13,12 @@
  */
 typedef struct {
   int currentNum;
-  GColor bgColor;
-  GColor fgColor;
-  GColor midColor1;
-  GColor midColor2;
   GPoint position;
   uint32_t currentImageId;
   int currentFontId;
   GBitmap* currentImage;
+  bool imageFromAtlas;
+  uint8_t atlasGeneration;
   BitmapLayer* imageLayer;
 } ClockDigit;
 
@@ -29,8 +27,20 @@ typedef struct {
  */
 void ClockDigit_setNumber(ClockDigit* this, int number, int fontId);
 void ClockDigit_setBlank(ClockDigit* this);
-void ClockDigit_setColor(ClockDigit* this, GColor fg, GColor bg);
 void ClockDigit_offsetPosition(ClockDigit* this, int posOffset);
 
+/*
+ * Sets the colors of all digits. Every digit image points at one shared
+ * palette per bit depth, so this only does work when the colors change.
+ */
+void ClockDigit_setColors(GColor fg, GColor bg);
+
+/*
+ * Keeps the images for every font in fontMask (1 << fontId) resident in the
+ * digit atlas, and frees the rest. Does nothing if the atlas is unavailable.
+ */
+void ClockDigit_setActiveFonts(uint8_t fontMask);
+void ClockDigit_freeAtlas();
+
 void ClockDigit_construct(ClockDigit* this, GPoint pos);
 void ClockDigit_destruct(ClockDigit* this);
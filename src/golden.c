@@ -0,0 +1,162 @@
+#ifdef TIMESTYLE_GOLDEN
+
+#include <pebble.h>
+#include "settings.h"
+#include "weather.h"
+#include "languages.h"
+#include "clock_digit.h"
+#include "util.h"
+#include "sidebar_widgets/sidebar_widgets.h"
+#include "replay.h"
+#include "golden.h"
+
+// give the watch some time to settle before starting
+#define START_DELAY_MS 2000
+
+// every widget type in every slot, in both font sizes, on both sides
+#define WIDGET_FRAME_COUNT (SIDEBAR_WIDGET_TYPE_COUNT * 4)
+
+// then every clock font with the same widgets
+#define FRAME_COUNT (WIDGET_FRAME_COUNT + FONT_SETTING_BOLD_M + 1)
+
+// 2016-10-01 10:08:30, in whatever the local time zone is
+#define GOLDEN_DATE 1475280000
+#define GOLDEN_TIME_OF_DAY (10 * 60 * 60 + 8 * 60 + 30)
+
+Layer* Golden_layer;
+void (*Golden_redrawCallback)(void);
+
+// -1 until the world has been frozen
+int Golden_currentFrame = -1;
+bool Golden_framePending = false;
+uint32_t Golden_frameStartMs;
+char Golden_frameName[32];
+
+void Golden_timerCallback(void* context);
+void Golden_updateProc(Layer* layer, GContext* ctx);
+
+void Golden_start(Layer* rootLayer, void (*redraw_callback)(void)) {
+  Golden_redrawCallback = redraw_callback;
+
+  // added last, so it's drawn after everything else
+  Golden_layer = layer_create(layer_get_bounds(rootLayer));
+  layer_set_update_proc(Golden_layer, Golden_updateProc);
+  layer_add_child(rootLayer, Golden_layer);
+
+  APP_LOG(APP_LOG_LEVEL_INFO, "Golden: %d frames, %d ms each", FRAME_COUNT, GOLDEN_HOLD_MS);
+
+  app_timer_register(START_DELAY_MS, Golden_timerCallback, NULL);
+}
+
+/*
+ * Fixes everything that isn't part of the matrix: the time, the phone and
+ * battery state, the weather, and the settings that the frames don't change
+ */
+void freezeWorld() {
+  time_t date = GOLDEN_DATE + GOLDEN_TIME_OF_DAY;
+  time_t now = date - localtime(&date)->tm_gmtoff;
+
+  Replay_freeze(now, true, (BatteryChargeState) { .charge_percent = 70 });
+
+  memset(&Weather_hourlyForecast, 0, sizeof(WeatherHourlyForecast));
+  Weather_weatherInfo.currentTemp = 21;
+  Weather_setCurrentCondition(PARTLY_CLOUDY);
+  Weather_weatherForecast.highTemp = 24;
+  Weather_weatherForecast.lowTemp = 13;
+  Weather_setForecastCondition(LIGHT_RAIN);
+
+  // the default colors
+  globalSettings.timeBgColor      = GColorBlack;
+  globalSettings.sidebarTextColor = GColorBlack;
+
+  #ifdef PBL_COLOR
+    globalSettings.timeColor      = GColorOrange;
+    globalSettings.sidebarColor   = GColorOrange;
+  #else
+    globalSettings.timeColor      = GColorWhite;
+    globalSettings.sidebarColor   = GColorWhite;
+  #endif
+
+  globalSettings.languageId = LANGUAGE_EN;
+  globalSettings.showLeadingZero = false;
+  globalSettings.useMetric = true;
+  globalSettings.showBatteryPct = true;
+  globalSettings.disableAutobattery = true;
+  globalSettings.healthUseDistance = false;
+  globalSettings.healthUseRestfulSleep = false;
+  globalSettings.decimalSeparator = '.';
+
+  strncpy(globalSettings.altclockName, "ALT", sizeof(globalSettings.altclockName));
+  globalSettings.altclockOffset = 0;
+}
+
+void applyFrame(int frame) {
+  if(frame < WIDGET_FRAME_COUNT) {
+    int type = frame / 4;
+
+    for(int i = 0; i < SIDEBAR_WIDGET_SLOTS; i++) {
+      globalSettings.widgets[i] = (type + i) % SIDEBAR_WIDGET_TYPE_COUNT;
+    }
+
+    globalSettings.useLargeFonts = frame & 1;
+    globalSettings.sidebarOnLeft = (frame >> 1) & 1;
+    globalSettings.clockFontId = FONT_SETTING_DEFAULT;
+  } else {
+    globalSettings.widgets[0] = DATE;
+    globalSettings.widgets[1] = WEATHER_CURRENT;
+    globalSettings.widgets[2] = BATTERY_METER;
+
+    globalSettings.useLargeFonts = false;
+    globalSettings.sidebarOnLeft = false;
+    globalSettings.clockFontId = frame - WIDGET_FRAME_COUNT;
+  }
+
+  snprintf(Golden_frameName, sizeof(Golden_frameName), "%s-%s-f%d-w%d-%d-%d",
+           globalSettings.useLargeFonts ? "large" : "small",
+           globalSettings.sidebarOnLeft ? "left" : "right",
+           globalSettings.clockFontId,
+           globalSettings.widgets[0], globalSettings.widgets[1], globalSettings.widgets[2]);
+
+  // the same as after new settings arrive from the phone
+  Settings_updateDynamicSettings();
+  SidebarWidgets_updateLoadedIcons();
+}
+
+void Golden_timerCallback(void* context) {
+  if(Golden_currentFrame < 0) {
+    freezeWorld();
+    Golden_currentFrame = 0;
+  }
+
+  if(Golden_currentFrame >= FRAME_COUNT) {
+    APP_LOG(APP_LOG_LEVEL_INFO, "Golden: done");
+    return;
+  }
+
+  applyFrame(Golden_currentFrame);
+
+  Golden_frameStartMs = time_get_ms();
+  Golden_framePending = true;
+
+  Golden_redrawCallback();
+  layer_mark_dirty(Golden_layer);
+}
+
+void Golden_updateProc(Layer* layer, GContext* ctx) {
+  if(!Golden_framePending) {
+    return;
+  }
+
+  Golden_framePending = false;
+
+  // everything else has been drawn by now
+  APP_LOG(APP_LOG_LEVEL_INFO, "Golden: frame %d %s in %d ms", Golden_currentFrame,
+          Golden_frameName, (int)(time_get_ms() - Golden_frameStartMs));
+
+  Golden_currentFrame++;
+
+  // hold still while the screenshot is taken
+  app_timer_register(GOLDEN_HOLD_MS, Golden_timerCallback, NULL);
+}
+
+#endif
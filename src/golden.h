@@ -0,0 +1,28 @@
+#pragma once
+#include <pebble.h>
+
+/*
+ * Golden image frames, only compiled in when building with TIMESTYLE_GOLDEN=1
+ * in the environment (see wscript), which also brings in the replay's
+ * stand-ins so that the time, Bluetooth and battery state are always the same.
+ *
+ * The watchface steps through a matrix of settings (every widget type in every
+ * slot, large fonts, sidebar left and right, every clock font) with fixed
+ * weather, holding each frame for GOLDEN_HOLD_MS. Each frame is logged with its
+ * name and the time it took to draw, which is when tools/golden.py takes an
+ * emulator screenshot and compares it against the checked in images.
+ *
+ * The health widget still shows whatever the emulator reports.
+ */
+#ifdef TIMESTYLE_GOLDEN
+
+#define GOLDEN_HOLD_MS 3000
+
+/*
+ * Starts stepping through the frames after a short delay. A layer is added on
+ * top of rootLayer to find out when each frame is drawn, and redraw_callback
+ * is called to apply each frame's settings
+ */
+void Golden_start(Layer* rootLayer, void (*redraw_callback)(void));
+
+#endif
@@ -26,15 +26,74 @@ Pebble.addEventListener('ready',
   }
 );
 
+// how many telemetry samples to keep on the phone
+var TELEMETRY_MAX_STORED_SAMPLES = 96;
+
+// decodes a TelemetrySample (see telemetry.h) from its little endian bytes
+function decodeTelemetrySample(bytes) {
+  function u8(offset) {
+    return bytes[offset];
+  }
+
+  function u16(offset) {
+    return bytes[offset] | (bytes[offset + 1] << 8);
+  }
+
+  function u32(offset) {
+    return (u16(offset) + u16(offset + 2) * 65536);
+  }
+
+  return {
+    timestamp: u32(0),
+    tickLatencyTotalMs: u32(4),
+    layerUpdateTotalMs: [u32(8), u32(12)],
+    heapLowWater: u16(16),
+    resourceLoads: u16(18),
+    ticks: u16(20),
+    tickLatencyMaxMs: u16(22),
+    tickDurationMaxMs: u16(24),
+    layerUpdates: [u16(26), u16(28)],
+    layerUpdateMaxMs: [u16(30), u16(32)],
+    inboxReceived: u8(34),
+    inboxDropped: u8(35),
+    outboxSent: u8(36),
+    outboxFailed: u8(37)
+  };
+}
+
+function storeTelemetrySample(payload) {
+  var sample = decodeTelemetrySample(payload.KEY_TELEMETRY_DATA);
+
+  console.log('Telemetry sample ' + (payload.KEY_TELEMETRY_INDEX + 1) + '/' +
+              payload.KEY_TELEMETRY_COUNT + ': ' + JSON.stringify(sample));
+
+  var samples = JSON.parse(window.localStorage.getItem('telemetry') || '[]');
+
+  // the sample that was still in progress last time gets sent again, so replace it
+  samples = samples.filter(function(s) {
+    return s.timestamp != sample.timestamp;
+  });
+
+  samples.push(sample);
+  samples = samples.slice(-TELEMETRY_MAX_STORED_SAMPLES);
+
+  window.localStorage.setItem('telemetry', JSON.stringify(samples));
+}
+
 // Listen for incoming messages
-// when one is received, we simply assume that it is a request for new weather data
+// apart from telemetry, we simply assume that it is a request for new weather data
 Pebble.addEventListener('appmessage',
   function(msg) {
     console.log('Recieved message: ' + JSON.stringify(msg.payload));
 
+    if(msg.payload.KEY_TELEMETRY_DATA !== undefined) {
+      storeTelemetrySample(msg.payload);
+      return;
+    }
+
     // in the case of recieving this, we assume the watch does, in fact, need weather data
     window.localStorage.setItem('disable_weather', 'no');
-    weather.updateWeather();
+    weather.requestWeather();
   }
 );
 
@@ -68,6 +127,120 @@ Pebble.addEventListener('showConfiguration', function(e) {
   }
 });
 
+// the settings blob format, see settings.h for the watch side
+var SETTINGS_BLOB_VERSION = 1;
+
+var SETTINGS_BLOB_FIELDS = [
+  { key: 'KEY_SETTING_COLOR_TIME',               id: 1,  type: 'color' },
+  { key: 'KEY_SETTING_COLOR_BG',                 id: 2,  type: 'color' },
+  { key: 'KEY_SETTING_COLOR_SIDEBAR',            id: 3,  type: 'color' },
+  { key: 'KEY_SETTING_SIDEBAR_TEXT_COLOR',       id: 4,  type: 'color' },
+  { key: 'KEY_SETTING_LANGUAGE_ID',              id: 5,  type: 'byte' },
+  { key: 'KEY_SETTING_SHOW_LEADING_ZERO',        id: 6,  type: 'byte' },
+  { key: 'KEY_SETTING_CLOCK_FONT_ID',            id: 7,  type: 'byte' },
+  { key: 'KEY_SETTING_BT_VIBE',                  id: 8,  type: 'byte' },
+  { key: 'KEY_SETTING_HOURLY_VIBE',              id: 9,  type: 'byte' },
+  { key: 'KEY_WIDGET_0_ID',                      id: 10, type: 'byte' },
+  { key: 'KEY_WIDGET_1_ID',                      id: 11, type: 'byte' },
+  { key: 'KEY_WIDGET_2_ID',                      id: 12, type: 'byte' },
+  { key: 'KEY_SETTING_SIDEBAR_LEFT',             id: 13, type: 'byte' },
+  { key: 'KEY_SETTING_USE_LARGE_FONTS',          id: 14, type: 'byte' },
+  { key: 'KEY_SETTING_USE_METRIC',               id: 15, type: 'byte' },
+  { key: 'KEY_SETTING_SHOW_BATTERY_PCT',         id: 16, type: 'byte' },
+  { key: 'KEY_SETTING_DISABLE_AUTOBATTERY',      id: 17, type: 'byte' },
+  { key: 'KEY_SETTING_HEALTH_USE_DISTANCE',      id: 18, type: 'byte' },
+  { key: 'KEY_SETTING_HEALTH_USE_RESTFUL_SLEEP', id: 19, type: 'byte' },
+  { key: 'KEY_SETTING_DECIMAL_SEPARATOR',        id: 20, type: 'char' },
+  { key: 'KEY_SETTING_ALTCLOCK_NAME',            id: 21, type: 'string' },
+  { key: 'KEY_SETTING_ALTCLOCK_OFFSET',          id: 22, type: 'byte' }
+];
+
+// the watch has room for 7 characters plus the terminator
+var SETTINGS_ALTCLOCK_NAME_MAX_LENGTH = 7;
+
+// reduces a 0xRRGGBB color to the watch's GColor8 byte
+function colorToGColor8(color) {
+  var r = (color >> 16) & 0xFF;
+  var g = (color >> 8) & 0xFF;
+  var b = color & 0xFF;
+
+  return 0xC0 | ((r >> 6) << 4) | ((g >> 6) << 2) | (b >> 6);
+}
+
+// the settings the watch last acknowledged, or null if we don't know them
+function loadSettingsSnapshot() {
+  var snapshot = JSON.parse(window.localStorage.getItem('settings_snapshot') || 'null');
+
+  if(snapshot && snapshot.version == SETTINGS_BLOB_VERSION) {
+    return snapshot.settings;
+  }
+
+  return null;
+}
+
+function saveSettingsSnapshot(settings) {
+  window.localStorage.setItem('settings_snapshot', JSON.stringify({
+    version: SETTINGS_BLOB_VERSION,
+    settings: settings
+  }));
+}
+
+// returns the UTF-8 bytes of a string, cut to at most maxBytes without
+// splitting a character
+function encodeUtf8(str, maxBytes) {
+  var utf8 = unescape(encodeURIComponent(str));
+  var end = Math.min(utf8.length, maxBytes);
+
+  // if the cut falls inside a character, leave all of that character out
+  if(end < utf8.length) {
+    while(end > 0 && (utf8.charCodeAt(end) & 0xC0) == 0x80) {
+      end--;
+    }
+  }
+
+  var bytes = [];
+
+  for(var i = 0; i < end; i++) {
+    bytes.push(utf8.charCodeAt(i));
+  }
+
+  return bytes;
+}
+
+// encodes the settings that differ from the snapshot into a settings blob
+function encodeSettingsBlob(settings, snapshot) {
+  var bytes = [SETTINGS_BLOB_VERSION];
+
+  SETTINGS_BLOB_FIELDS.forEach(function(field) {
+    var value = settings[field.key];
+
+    if(value === undefined || value === null || (typeof value == 'number' && isNaN(value))) {
+      return;
+    }
+
+    if(snapshot && snapshot[field.key] === value) {
+      return;
+    }
+
+    bytes.push(field.id);
+
+    if(field.type == 'color') {
+      bytes.push(colorToGColor8(value));
+    } else if(field.type == 'char') {
+      bytes.push(String(value).charCodeAt(0) & 0xFF);
+    } else if(field.type == 'string') {
+      var utf8 = encodeUtf8(String(value), SETTINGS_ALTCLOCK_NAME_MAX_LENGTH);
+
+      bytes.push(utf8.length);
+      bytes.push.apply(bytes, utf8);
+    } else {
+      bytes.push(value & 0xFF);
+    }
+  });
+
+  return bytes;
+}
+
 Pebble.addEventListener('webviewclosed', function(e) {
   var configData = decodeURIComponent(e.response);
 
@@ -76,7 +249,8 @@ Pebble.addEventListener('webviewclosed', function(e) {
 
     console.log("Config data recieved!" + JSON.stringify(configData));
 
-    // prepare a structure to hold everything we'll send to the watch
+    // prepare a structure to hold all the settings, which are then encoded
+    // into the settings blob for the watch
     var dict = {};
 
     // color settings
@@ -243,20 +417,42 @@ Pebble.addEventListener('webviewclosed', function(e) {
 
     window.localStorage.setItem('disable_weather', disableWeather);
 
-    var enableForecast;
+    // only send the settings that the watch doesn't have yet
+    var snapshot = loadSettingsSnapshot();
+    var blob = encodeSettingsBlob(dict, snapshot);
+
+    var message = {};
 
-    if(widgetIDs.indexOf(8) != -1) {
-      enableForecast = 'yes';
+    if(blob.length > 1) {
+      message.KEY_SETTINGS = blob;
     }
 
-    window.localStorage.setItem('enable_forecast', enableForecast);
+    // debug options
+    if(configData.telemetry_dump == 'yes') {
+      message.KEY_TELEMETRY_DUMP = 1;
+    }
+
+    if(Object.keys(message).length === 0) {
+      console.log('Settings unchanged, nothing to send');
+      weather.updateWeather(true);
+      return;
+    }
 
-    console.log('Preparing message: ', JSON.stringify(dict));
+    console.log('Preparing message: ', JSON.stringify(message));
 
     // Send settings to Pebble watchapp
-    Pebble.sendAppMessage(dict, function(){
+    Pebble.sendAppMessage(message, function(){
       console.log('Sent config data to Pebble, now trying to get weather');
 
+      // the watch has these settings now, so remember them for next time
+      var acknowledged = snapshot || {};
+
+      for(var key in dict) {
+        acknowledged[key] = dict[key];
+      }
+
+      saveSettingsSnapshot(acknowledged);
+
       // after sending config data, force a weather refresh in case that changed
       weather.updateWeather(true);
     }, function() {
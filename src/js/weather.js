@@ -1,16 +1,86 @@
 /* general utility stuff related to weather */
 
+/*
+ Each weather provider exports:
+
+ getRequests(location, wanted) - the requests needed to get the wanted
+   ({current: bool, forecast: bool}) data for a location ({name} or {coords}),
+   as a list of {url, types, parse}. types lists which of 'current' and
+   'forecast' the request covers, and parse(json) returns what it found as
+   {current: {temperature, condition}, hourly: {startTime, intervalMinutes,
+   points}, daily: {high, low, condition}} (any of them, temps in degrees C),
+   or null if the response is no good.
+ mapCondition(code, isNight) - the WeatherIcons code for a condition.
+ serve(url, headers, callback) - optional, answers the provider's requests
+   instead of the network.
+*/
 var weatherProviders = {
   'owm'          : require('weather_owm'),
   // 'forecast'     : require('weather_forecast'),
-  'wunderground' : require('weather_wunderground')
+  'wunderground' : require('weather_wunderground'),
+  'mock'         : require('weather_mock')
 };
 
 var DEFAULT_WEATHER_PROVIDER = 'owm';
 
-// get new forecasts if 3 hours have elapsed
-var FORECAST_MAX_AGE = 3 * 60 * 60 * 1000;
-var MAX_FAILURES = 3;
+// how long each kind of data stays fresh before it's fetched again
+var STALENESS_BUDGETS = {
+  current  : 30 * 60 * 1000,
+  forecast : 3 * 60 * 60 * 1000,
+  location : 30 * 60 * 1000
+};
+
+// where the time each kind of data was last fetched is kept
+var LAST_FETCH_KEYS = {
+  current  : 'last_weather_time',
+  forecast : 'last_forecast_time'
+};
+
+// a cached location is kept until it's older than the location budget, and
+// after that as long as a (cheap) coarse location says we haven't moved further
+// than this, in meters
+var LOCATION_MOVE_THRESHOLD = 2000;
+
+// coarse locations less accurate than this (in meters) get a GPS fix instead
+var COARSE_LOCATION_MAX_ACCURACY = 3000;
+
+// weather results are cached per cell of this many degrees of latitude/longitude
+var WEATHER_CELL_SIZE = 0.1;
+var WEATHER_CACHE_MAX_CELLS = 4;
+
+// update requests this close together (say, a reconnect and a 'ready') are merged
+var DEDUPE_WINDOW = 3000;
+
+// an update that hasn't finished after this long has failed
+var UPDATE_TIMEOUT = 60 * 1000;
+
+// retries back off exponentially from RETRY_BASE_DELAY, with jitter
+var RETRY_BASE_DELAY = 5000;
+var RETRY_MAX_DELAY = 5 * 60 * 1000;
+var MAX_FAILURES = 5;
+
+// wait a bit between sending the current conditions and the forecast
+var FORECAST_SEND_DELAY = 5000;
+
+// raw responses are kept (per URL) for revalidating with ETag/Last-Modified
+var HTTP_CACHE_MAX_ENTRIES = 4;
+
+var pendingUpdate = null;
+var pendingForce = false;
+var pendingResend = false;
+
+var updateInProgress = false;
+var updateForced = false;
+var updateResend = false;
+var rerunForced = false;
+var rerunResend = false;
+var updateTimeout = null;
+var remainingFetches = {};
+
+// the weather cache cell of the update in progress
+var currentCell = null;
+var forecastDelay = 0;
+
 var currentFailures = 0;
 
 // icon codes for sending weather icons to pebble
@@ -40,114 +110,548 @@ function getCurrentWeatherProvider() {
   }
 }
 
+function isStale(type) {
+  var lastFetch = parseInt(window.localStorage.getItem(LAST_FETCH_KEYS[type]), 10) || 0;
+
+  return Date.now() - lastFetch > STALENESS_BUDGETS[type];
+}
+
+function markFetched(type) {
+  window.localStorage.setItem(LAST_FETCH_KEYS[type], Date.now());
+}
+
+/*
+ Asks for a weather update. Requests are merged for a moment before anything
+ happens, and the update only fetches the data that's gone stale (or all of
+ it, if forced).
+*/
 function updateWeather(forceUpdate) {
+  pendingForce = pendingForce || !!forceUpdate;
+
+  // one is already on the way, this request just joins it
+  if(pendingUpdate !== null) {
+    return;
+  }
+
+  scheduleUpdate(DEDUPE_WINDOW);
+}
+
+/*
+ Asks for a weather update on behalf of the watch, which wants the weather
+ even if it hasn't gone stale: fresh data is sent again from the cache.
+*/
+function requestWeather() {
+  pendingResend = true;
+  updateWeather(false);
+}
+
+function scheduleUpdate(delay) {
+  pendingUpdate = setTimeout(function() {
+    var force = pendingForce;
+    var resend = pendingResend;
+
+    pendingUpdate = null;
+    pendingForce = false;
+    pendingResend = false;
+
+    runUpdate(force, resend);
+  }, delay);
+}
+
+function runUpdate(force, resend) {
   var weatherDisabled = window.localStorage.getItem('disable_weather');
 
   console.log("Get weather function called! DisableWeather is '" + weatherDisabled + "'");
 
-  // if weather is not disabled...
-  if(weatherDisabled !== "yes") {
-    // in case "disable_weather" is empty or something weird, set it to "no"
-    // since we already know it's not "yes"
-    window.localStorage.setItem('disable_weather', 'no');
+  if(weatherDisabled === "yes") {
+    return;
+  }
+
+  // in case "disable_weather" is empty or something weird, set it to "no"
+  // since we already know it's not "yes"
+  window.localStorage.setItem('disable_weather', 'no');
 
-    var weatherLoc = window.localStorage.getItem('weather_loc');
+  // the update in progress will take care of it, unless this one has to
+  // refetch or resend everything
+  if(updateInProgress) {
+    rerunForced = rerunForced || force;
+    rerunResend = rerunResend || resend;
+    return;
+  }
 
-    if(weatherLoc) {
-      getCurrentWeatherProvider().getWeather(weatherLoc);
-      if(forceUpdate || isForecastNeeded()) {
-        getCurrentWeatherProvider().getForecast(weatherLoc);
+  // the watch asked, so it gets everything: what's fresh comes from the cache
+  var needCurrent = force || resend || isStale('current');
+  var needForecast = force || resend || isForecastNeeded();
+
+  if(!needCurrent && !needForecast) {
+    console.log('Weather is still fresh, not fetching');
+    return;
+  }
+
+  updateInProgress = true;
+  updateForced = force;
+  updateResend = resend;
+  remainingFetches = { current: needCurrent, forecast: needForecast };
+  updateTimeout = setTimeout(function() { finishUpdate(false); }, UPDATE_TIMEOUT);
+
+  forecastDelay = needCurrent ? FORECAST_SEND_DELAY : 0;
+
+  getLocation(function(location) {
+    var wanted = { current: false, forecast: false };
+
+    currentCell = getWeatherCell(location);
+
+    // if this cell was fetched recently enough, just send that again
+    ['current', 'forecast'].forEach(function(type) {
+      if(!remainingFetches[type]) {
+        return;
       }
-    } else {
-      getLocation();
+
+      var cached = getCachedWeather(currentCell, type);
+
+      if(cached) {
+        deliverToPebble(type, cached);
+      } else {
+        wanted[type] = true;
+      }
+    });
+
+    if(wanted.current || wanted.forecast) {
+      fetchFromProvider(getCurrentWeatherProvider(), location, wanted);
     }
+  });
+}
+
+function fetchFromProvider(provider, location, wanted) {
+  provider.getRequests(location, wanted).forEach(function(request) {
+    // the request is good for as long as the data that goes stale first
+    var ttl = Math.min.apply(null, request.types.map(function(type) {
+      return STALENESS_BUDGETS[type];
+    }));
+
+    cachedRequest(provider, request.url, ttl, function(responseText) {
+      var result = null;
+
+      try {
+        result = request.parse(JSON.parse(responseText));
+      } catch(e) {
+        console.log('Bad weather response: ' + e);
+      }
+
+      if(!result) {
+        fetchFailed();
+        return;
+      }
+
+      sendResult(result);
+    });
+  });
+}
+
+// turns a provider's (normalized) result into messages for the watch
+function sendResult(result) {
+  if(result.current) {
+    console.log('Temperature is ' + result.current.temperature);
+
+    sendWeatherToPebble('current', {
+      'KEY_TEMPERATURE': Math.round(result.current.temperature),
+      'KEY_CONDITION_CODE': result.current.condition
+    });
+  }
+
+  if(result.hourly) {
+    console.log('Forecast has ' + result.hourly.points.length + ' points, ' +
+                result.hourly.intervalMinutes + ' minutes apart');
+
+    sendWeatherToPebble('forecast', {
+      'KEY_WEATHER_HOURLY': encodeHourlyForecast(result.hourly.startTime,
+                                                 result.hourly.intervalMinutes,
+                                                 result.hourly.points)
+    });
+  } else if(result.daily) {
+    console.log('Forecast high/low temps are ' + result.daily.high + '/' + result.daily.low);
+
+    // providers without hourly data still get the old style forecast
+    sendWeatherToPebble('forecast', {
+      'KEY_FORECAST_CONDITION': result.daily.condition,
+      'KEY_FORECAST_TEMP_HIGH': result.daily.high,
+      'KEY_FORECAST_TEMP_LOW': result.daily.low
+    });
+  }
+}
+
+/*
+ Calls back with the response for a URL, from the cache if it's less than
+ ttl ms old. Older responses are revalidated with If-None-Match or
+ If-Modified-Since, so an unchanged one doesn't have to be downloaded again
+*/
+function cachedRequest(provider, url, ttl, callback) {
+  var cache = JSON.parse(window.localStorage.getItem('http_cache') || '{}');
+  var entry = cache[url];
+  var headers = {};
+
+  if(entry && Date.now() - entry.time <= ttl) {
+    console.log('Using cached response for ' + url);
+    callback(entry.body);
+    return;
+  }
+
+  if(entry && entry.etag) {
+    headers['If-None-Match'] = entry.etag;
+  }
+
+  if(entry && entry.lastModified) {
+    headers['If-Modified-Since'] = entry.lastModified;
+  }
+
+  var serve = provider.serve || httpRequest;
+
+  serve(url, headers, function(status, body, responseHeaders) {
+    if(status == 304 && entry) {
+      console.log('Response not modified: ' + url);
+      body = entry.body;
+    } else if(status != 200) {
+      console.log('Request failed (' + status + '): ' + url);
+      fetchFailed();
+      return;
+    }
+
+    // the cache may have changed while we waited
+    cache = JSON.parse(window.localStorage.getItem('http_cache') || '{}');
+    cache[url] = {
+      time: Date.now(),
+      etag: responseHeaders['ETag'] || (entry && status == 304 ? entry.etag : null),
+      lastModified: responseHeaders['Last-Modified'] || (entry && status == 304 ? entry.lastModified : null),
+      body: body
+    };
+
+    // only keep the newest responses
+    Object.keys(cache).sort(function(a, b) {
+      return cache[b].time - cache[a].time;
+    }).slice(HTTP_CACHE_MAX_ENTRIES).forEach(function(oldUrl) {
+      delete cache[oldUrl];
+    });
+
+    window.localStorage.setItem('http_cache', JSON.stringify(cache));
+
+    callback(body);
+  });
+}
+
+function httpRequest(url, headers, callback) {
+  var xhr = new XMLHttpRequest();
+
+  console.log(url);
+
+  xhr.onload = function () {
+    callback(this.status, this.responseText, {
+      'ETag': this.getResponseHeader('ETag'),
+      'Last-Modified': this.getResponseHeader('Last-Modified')
+    });
+  };
+  xhr.onerror = function () {
+    console.log('Request failed: ' + url);
+    fetchFailed();
+  };
+  xhr.open('GET', url);
+
+  Object.keys(headers).forEach(function(header) {
+    xhr.setRequestHeader(header, headers[header]);
+  });
+
+  xhr.send();
+}
+
+// the cache cell for a location: the location name, or the rounded coordinates
+function getWeatherCell(location) {
+  var provider = window.localStorage.getItem('weather_datasource') || DEFAULT_WEATHER_PROVIDER;
+
+  if(location.name) {
+    return provider + ':' + location.name;
+  }
+
+  var lat = Math.round(location.coords.latitude / WEATHER_CELL_SIZE) * WEATHER_CELL_SIZE;
+  var lon = Math.round(location.coords.longitude / WEATHER_CELL_SIZE) * WEATHER_CELL_SIZE;
+
+  return provider + ':' + lat.toFixed(1) + ',' + lon.toFixed(1);
+}
+
+function loadWeatherCache() {
+  return JSON.parse(window.localStorage.getItem('weather_cache') || '{}');
+}
+
+// the message last sent for this cell and type, if it's still fresh
+function getCachedWeather(cell, type) {
+  var entry = loadWeatherCache()[cell];
+
+  if(entry && entry[type] && Date.now() - entry[type].time <= STALENESS_BUDGETS[type]) {
+    console.log('Using cached ' + type + ' weather for ' + cell);
+    return entry[type].dictionary;
   }
+
+  return null;
 }
 
-function getLocation() {
+function cacheWeather(cell, type, dictionary) {
+  if(!cell) {
+    return;
+  }
+
+  var cache = loadWeatherCache();
+
+  cache[cell] = cache[cell] || {};
+  cache[cell][type] = { time: Date.now(), dictionary: dictionary };
+  cache[cell].lastUsed = Date.now();
+
+  // only keep the most recently used cells
+  var cells = Object.keys(cache).sort(function(a, b) {
+    return cache[b].lastUsed - cache[a].lastUsed;
+  });
+
+  cells.slice(WEATHER_CACHE_MAX_CELLS).forEach(function(oldCell) {
+    delete cache[oldCell];
+  });
+
+  window.localStorage.setItem('weather_cache', JSON.stringify(cache));
+}
+
+/*
+ Calls back with either {name: '...'} for a configured location, or a
+ position with coords. The last position (with its accuracy and timestamp)
+ is cached: within the location budget it's used as is, and after that a
+ coarse network location checks whether we've moved before asking for GPS.
+*/
+function getLocation(callback) {
+  var weatherLoc = window.localStorage.getItem('weather_loc');
+
+  if(weatherLoc) {
+    callback({ name: weatherLoc });
+    return;
+  }
+
+  var cachedLocation = JSON.parse(window.localStorage.getItem('location_cache') || 'null');
+
+  if(cachedLocation && Date.now() - cachedLocation.timestamp <= STALENESS_BUDGETS.location) {
+    callback({ coords: cachedLocation });
+    return;
+  }
+
+  function useLocation(location) {
+    window.localStorage.setItem('location_cache', JSON.stringify(location));
+    callback({ coords: location });
+  }
+
+  function locationFailed(err) {
+    console.log('location error on the JS side!');
+
+    // an old location is better than no weather at all
+    if(cachedLocation) {
+      callback({ coords: cachedLocation });
+    } else {
+      finishUpdate(false);
+    }
+  }
+
   navigator.geolocation.getCurrentPosition(
-    locationSuccess,
-    locationError,
-    {timeout: 15000, maximumAge: 60000}
+    function(pos) {
+      var coarseLocation = toCachedLocation(pos);
+
+      // haven't gone anywhere? keep the (probably more accurate) cached position
+      if(cachedLocation) {
+        var moved = getDistance(cachedLocation, coarseLocation);
+
+        if(moved <= Math.max(LOCATION_MOVE_THRESHOLD, coarseLocation.accuracy)) {
+          cachedLocation.timestamp = coarseLocation.timestamp;
+          useLocation(cachedLocation);
+          return;
+        }
+      }
+
+      if(coarseLocation.accuracy <= COARSE_LOCATION_MAX_ACCURACY) {
+        useLocation(coarseLocation);
+        return;
+      }
+
+      // the coarse location is too rough, so it's time for the GPS
+      navigator.geolocation.getCurrentPosition(
+        function(gpsPos) {
+          useLocation(toCachedLocation(gpsPos));
+        },
+        function(err) {
+          useLocation(coarseLocation);
+        },
+        {enableHighAccuracy: true, timeout: 30000, maximumAge: 60000}
+      );
+    },
+    locationFailed,
+    {enableHighAccuracy: false, timeout: 15000, maximumAge: STALENESS_BUDGETS.location}
   );
 }
 
-function locationError(err) {
-  console.log('location error on the JS side! Failure #' + currentFailures);
-  //if we fail, try using the cached location
-  if(currentFailures <= MAX_FAILURES) {
-    // reset cache time
-    window.localStorage.setItem('weather_loc_cache_time', (new Date().getTime() / 1000));
+function toCachedLocation(pos) {
+  return {
+    latitude: pos.coords.latitude,
+    longitude: pos.coords.longitude,
+    accuracy: pos.coords.accuracy || 0,
+    timestamp: Date.now()
+  };
+}
 
-    // try again
-    updateWeather();
-    currentFailures++;
-  } else {
-    // until we get too many failures, at which point give up
-    currentFailures = 0;
+// the distance between two locations in meters, ignoring the earth's flattening
+function getDistance(a, b) {
+  var EARTH_RADIUS = 6371000;
+  var toRadians = Math.PI / 180;
+
+  var dLat = (b.latitude - a.latitude) * toRadians;
+  var dLon = (b.longitude - a.longitude) * toRadians;
+
+  var h = Math.sin(dLat / 2) * Math.sin(dLat / 2) +
+          Math.cos(a.latitude * toRadians) * Math.cos(b.latitude * toRadians) *
+          Math.sin(dLon / 2) * Math.sin(dLon / 2);
+
+  return 2 * EARTH_RADIUS * Math.asin(Math.min(1, Math.sqrt(h)));
+}
+
+// called as each kind of data makes it to the watch, or fails to
+function fetchSucceeded(type) {
+  markFetched(type);
+
+  if(!updateInProgress) {
+    return;
+  }
+
+  remainingFetches[type] = false;
+
+  if(!remainingFetches.current && !remainingFetches.forecast) {
+    finishUpdate(true);
   }
 }
 
-function locationSuccess(pos) {
-  getCurrentWeatherProvider().getWeatherFromCoords(pos);
+function fetchFailed() {
+  if(updateInProgress) {
+    finishUpdate(false);
+  }
+}
+
+function finishUpdate(success) {
+  var force = updateForced;
+  var resend = updateResend;
 
-  if(isForecastNeeded()) {
-    setTimeout(function() { getCurrentWeatherProvider().getForecastFromCoords(pos); }, 5000);
+  clearTimeout(updateTimeout);
+  updateInProgress = false;
+
+  // something (like a config change or the watch) asked for everything while
+  // we were busy
+  if(rerunForced || rerunResend) {
+    var rerunForce = rerunForced;
+
+    pendingResend = pendingResend || rerunResend;
+    rerunForced = false;
+    rerunResend = false;
+    updateWeather(rerunForce);
+  }
+
+  if(success) {
+    currentFailures = 0;
+    return;
+  }
+
+  currentFailures++;
+
+  console.log('Weather update failed! Failure #' + currentFailures);
+
+  if(currentFailures > MAX_FAILURES) {
+    // give up until something asks again
+    currentFailures = 0;
+    return;
+  }
+
+  // back off exponentially, with jitter so that retries don't line up
+  var delay = Math.min(RETRY_BASE_DELAY * Math.pow(2, currentFailures - 1), RETRY_MAX_DELAY);
+  delay = delay / 2 + Math.random() * delay / 2;
+
+  if(pendingUpdate === null) {
+    pendingForce = pendingForce || force;
+    pendingResend = pendingResend || resend;
+    scheduleUpdate(delay);
   }
 }
 
+// the hourly forecast drives both weather widgets now, so it's needed
+// whenever the weather is enabled at all
 function isForecastNeeded() {
-  var enableForecast = window.localStorage.getItem('enable_forecast');
-  var lastForecastTime = window.localStorage.getItem('last_forecast_time');
-  var forecastAge = Date.now() - lastForecastTime;
+  return isStale('forecast');
+}
 
-  console.log("Forecast requested! Age is " + forecastAge);
+// the watch keeps this many forecast points (see WEATHER_HOURLY_POINTS)
+var HOURLY_FORECAST_MAX_POINTS = 16;
 
-  if(enableForecast === 'yes' && forecastAge > FORECAST_MAX_AGE) {
-    return true;
-  } else {
-    return false;
+/*
+ Packs a list of forecast points ({temp, condition}, temps in degrees C)
+ starting at startTime (in seconds) and intervalMinutes apart into the
+ byte array the watch expects for KEY_WEATHER_HOURLY
+*/
+function encodeHourlyForecast(startTime, intervalMinutes, points) {
+  var count = Math.min(points.length, HOURLY_FORECAST_MAX_POINTS);
+
+  var bytes = [
+    startTime & 0xFF, (startTime >>> 8) & 0xFF, (startTime >>> 16) & 0xFF, (startTime >>> 24) & 0xFF,
+    intervalMinutes & 0xFF, (intervalMinutes >> 8) & 0xFF,
+    count
+  ];
+
+  for(var i = 0; i < count; i++) {
+    var temp = Math.max(-128, Math.min(127, Math.round(points[i].temp)));
+
+    bytes.push(temp & 0xFF);
+    bytes.push(points[i].condition);
   }
+
+  return bytes;
 }
 
-function sendWeatherToPebble(dictionary) {
-  // Send to Pebble
-  Pebble.sendAppMessage(dictionary,
-    function(e) {
-      console.log('Weather info sent to Pebble successfully!');
-    },
-    function(e) {
-      // if we fail, wait a couple seconds, then try again
-      if(currentFailures < failureRetryAmount) {
-        // call it again somewhere between 3 and 10 seconds
-        setTimeout(updateWeather, Math.floor(Math.random() * 10000) + 3000);
+function sendWeatherToPebble(type, dictionary) {
+  cacheWeather(currentCell, type, dictionary);
+  deliverToPebble(type, dictionary);
+}
 
-        currentFailures++;
-      } else {
-        currentFailures = 0;
-      }
+function deliverToPebble(type, dictionary) {
+  console.log(JSON.stringify(dictionary));
 
-      console.log('Error sending weather info to Pebble! Count: #' + currentFailures);
-    }
-  );
+  // Send to Pebble, giving the watch a moment between the two kinds of data
+  setTimeout(function() {
+    Pebble.sendAppMessage(dictionary,
+      function(e) {
+        console.log('Weather info (' + type + ') sent to Pebble successfully!');
+        fetchSucceeded(type);
+      },
+      function(e) {
+        console.log('Error sending weather info (' + type + ') to Pebble!');
+        fetchFailed();
+      }
+    );
+  }, (type == 'forecast') ? forecastDelay : 0);
 }
 
-var xhrRequest = function (url, type, callback) {
-  var xhr = new XMLHttpRequest();
-  xhr.onload = function () {
-    callback(this.responseText);
-  };
-  xhr.open(type, url);
-  xhr.send();
-};
+/*
+ The icon code for an entry of a provider's condition table: either an icon
+ name, or a [day, night] pair of them
+*/
+function getIcon(icon, isNight) {
+  if(Array.isArray(icon)) {
+    icon = icon[isNight ? 1 : 0];
+  }
+
+  return (WeatherIcons[icon] !== undefined) ? WeatherIcons[icon] : WeatherIcons.WEATHER_GENERIC;
+}
 
 // the individual weather providers need access to the weather icons
 module.exports.icons = WeatherIcons;
-
-// utility functions common to all weather providers
-module.exports.xhrRequest = xhrRequest;
-module.exports.sendWeatherToPebble = sendWeatherToPebble;
+module.exports.getIcon = getIcon;
 
 // called by app.js
 // updates the weather if needed, respecting all provider settings in localStorage
 module.exports.updateWeather = updateWeather;
+
+// called by app.js when the watch asks for the weather
+module.exports.requestWeather = requestWeather;
@@ -0,0 +1,116 @@
+var weatherCommon = require('weather');
+
+/*
+ A provider that never leaves the phone: it answers its own requests with
+ canned JSON, so the whole update pipeline (caching, parsing, encoding and
+ sending) can be run without a network or an API key. Select it by setting
+ 'weather_datasource' to 'mock' in localStorage.
+*/
+
+var MOCK_ETAG = '"mock-1"';
+
+var CONDITION_ICONS = {
+  'clear'  : ['CLEAR_DAY', 'CLEAR_NIGHT'],
+  'cloudy' : 'CLOUDY_DAY',
+  'rain'   : 'LIGHT_RAIN',
+  'snow'   : 'LIGHT_SNOW',
+  'storm'  : 'THUNDERSTORM'
+};
+
+var FORECAST_CONDITIONS = ['clear', 'clear', 'cloudy', 'rain', 'storm', 'cloudy', 'clear', 'snow'];
+
+// "public" functions
+
+module.exports.getRequests = getRequests;
+module.exports.mapCondition = mapCondition;
+module.exports.serve = serve;
+
+// like wunderground, one request gets everything
+function getRequests(location, wanted) {
+  var types = [];
+
+  if(wanted.current) {
+    types.push('current');
+  }
+
+  if(wanted.forecast) {
+    types.push('forecast');
+  }
+
+  var query = location.name ? encodeURIComponent(location.name) :
+              location.coords.latitude + ',' + location.coords.longitude;
+
+  return [{
+    url: 'mock://weather/' + types.join('+') + '/' + query,
+    types: types,
+    parse: parseWeather
+  }];
+}
+
+function mapCondition(conditionCode, isNight) {
+  return weatherCommon.getIcon(CONDITION_ICONS[conditionCode], isNight);
+}
+
+/*
+ Stands in for the HTTP request: calls back with the status, the body and the
+ response headers. Honors If-None-Match like a real server would
+*/
+function serve(url, requestHeaders, callback) {
+  console.log('Mock weather request: ' + url);
+
+  if(requestHeaders['If-None-Match'] == MOCK_ETAG) {
+    callback(304, '', {});
+    return;
+  }
+
+  callback(200, JSON.stringify(getCannedResponse(url)), { 'ETag': MOCK_ETAG });
+}
+
+// "private" functions
+
+function getCannedResponse(url) {
+  var types = url.split('/')[3];
+  var response = {};
+
+  // forecast points start at the top of the current hour
+  var startTime = Math.floor(Date.now() / 3600000) * 3600;
+
+  if(types.indexOf('current') >= 0) {
+    response.current = { temp: 18.4, condition: 'cloudy', night: false };
+  }
+
+  if(types.indexOf('forecast') >= 0) {
+    response.forecast = {
+      start: startTime,
+      interval: 180,
+      points: FORECAST_CONDITIONS.map(function(condition, i) {
+        return { temp: 12 + 2 * Math.sin(i * Math.PI / 4), condition: condition };
+      })
+    };
+  }
+
+  return response;
+}
+
+function parseWeather(json) {
+  var result = {};
+
+  if(json.current) {
+    result.current = {
+      temperature: json.current.temp,
+      condition: mapCondition(json.current.condition, json.current.night)
+    };
+  }
+
+  if(json.forecast) {
+    result.hourly = {
+      startTime: json.forecast.start,
+      intervalMinutes: json.forecast.interval,
+      points: json.forecast.points.map(function(point) {
+        return { temp: point.temp, condition: mapCondition(point.condition, false) };
+      })
+    };
+  }
+
+  return result;
+}
@@ -2,184 +2,130 @@
 var secrets = require('secrets');
 var weatherCommon = require('weather');
 
-// "public" functions
-
-module.exports.getWeather = getWeather;
-module.exports.getWeatherFromCoords = getWeatherFromCoords;
-module.exports.getForecast = getForecast;
-module.exports.getForecastFromCoords = getForecastFromCoords;
-
-function getWeather(weatherLoc) {
-  var url = 'http://api.openweathermap.org/data/2.5/weather?q=' +
-      encodeURIComponent(weatherLoc) + '&units=metric&appid=' + secrets.OWM_APP_ID;
+// condition codes that get their own icon, and the icons for the rest of
+// each hundred (https://openweathermap.org/weather-conditions)
+var CONDITION_ICONS = {
+  500 : 'LIGHT_RAIN',
+  501 : 'HEAVY_RAIN',
+  502 : 'HEAVY_RAIN',
+  503 : 'HEAVY_RAIN',
+  504 : 'HEAVY_RAIN',
+  511 : 'RAINING_AND_SNOWING',
+  600 : 'LIGHT_SNOW',
+  611 : 'RAINING_AND_SNOWING',
+  612 : 'RAINING_AND_SNOWING',
+  613 : 'RAINING_AND_SNOWING',
+  615 : 'RAINING_AND_SNOWING',
+  616 : 'RAINING_AND_SNOWING',
+  620 : 'LIGHT_SNOW',
+  800 : ['CLEAR_DAY', 'CLEAR_NIGHT'],
+  801 : ['PARTLY_CLOUDY', 'PARTLY_CLOUDY_NIGHT'],
+  802 : ['PARTLY_CLOUDY', 'PARTLY_CLOUDY_NIGHT']
+};
+
+var CONDITION_GROUP_ICONS = {
+  2 : 'THUNDERSTORM',
+  3 : 'LIGHT_RAIN',  // drizzle
+  5 : 'LIGHT_RAIN',
+  6 : 'HEAVY_SNOW',
+  7 : 'CLOUDY_DAY',  // fog, dust, etc
+  8 : 'CLOUDY_DAY'
+};
 
-  getAndSendCurrentWeather(url);
-}
+// "public" functions
 
-function getWeatherFromCoords(pos) {
-  // Construct URL
-  var url = 'http://api.openweathermap.org/data/2.5/weather?lat=' +
-      pos.coords.latitude + '&lon=' + pos.coords.longitude + '&units=metric&appid=' + secrets.OWM_APP_ID;
-  console.log(url);
+module.exports.getRequests = getRequests;
+module.exports.mapCondition = mapCondition;
 
-  getAndSendCurrentWeather(url);
-}
+/*
+ OWM's free API has no single call with both the current conditions and the
+ forecast for a named location, so they're separate requests
+*/
+function getRequests(location, wanted) {
+  var requests = [];
+  var query = getLocationQuery(location) + '&units=metric&appid=' + secrets.OWM_APP_ID;
+
+  if(wanted.current) {
+    requests.push({
+      url: 'http://api.openweathermap.org/data/2.5/weather?' + query,
+      types: ['current'],
+      parse: parseCurrentWeather
+    });
+  }
 
-function getForecast(weatherLoc) {
-  var forecastURL = 'http://api.openweathermap.org/data/2.5/forecast?q=' +
-      encodeURIComponent(weatherLoc) + '&cnt=8&units=metric&appid=' + secrets.OWM_APP_ID;
+  if(wanted.forecast) {
+    requests.push({
+      url: 'http://api.openweathermap.org/data/2.5/forecast?' + query + '&cnt=16',
+      types: ['forecast'],
+      parse: parseForecast
+    });
+  }
 
-  getAndSendWeatherForecast(forecastURL);
+  return requests;
 }
 
-function getForecastFromCoords(pos) {
-  var forecastURL = 'http://api.openweathermap.org/data/2.5/forecast?lat=' +
-      pos.coords.latitude + '&lon=' + pos.coords.longitude + '&cnt=8&units=metric&appid=' + secrets.OWM_APP_ID;
+function mapCondition(conditionCode, isNight) {
+  var icon = CONDITION_ICONS[conditionCode] || CONDITION_GROUP_ICONS[Math.floor(conditionCode / 100)];
 
-  getAndSendWeatherForecast(forecastURL);
+  return weatherCommon.getIcon(icon, isNight);
 }
 
 // "private" functions
 
-// accepts an openweathermap url, gets weather data from it, and sends it to the watch
-function getAndSendCurrentWeather(url) {
-  weatherCommon.xhrRequest(url, 'GET',
-    function(responseText) {
-      // responseText contains a JSON object with weather info
-      var json = JSON.parse(responseText);
-
-      if(json.cod == "200") {
-        var temperature = Math.round(json.main.temp);
-        console.log('Temperature is ' + temperature);
-
-        // Conditions
-        var conditionCode = json.weather[0].id;
-        console.log('Condition code is ' + conditionCode);
-
-        // night state
-        var isNight = (json.weather[0].icon.slice(-1) == 'n') ? 1 : 0;
-
-        var iconToLoad = getIconForConditionCode(conditionCode, isNight);
-
-        // Assemble dictionary using our keys
-        var dictionary = {
-          'KEY_TEMPERATURE': temperature,
-          'KEY_CONDITION_CODE': iconToLoad
-        };
-
-        console.log(JSON.stringify(dictionary));
+function getLocationQuery(location) {
+  if(location.name) {
+    return 'q=' + encodeURIComponent(location.name);
+  }
 
-        weatherCommon.sendWeatherToPebble(dictionary);
-      }
-  });
+  return 'lat=' + location.coords.latitude + '&lon=' + location.coords.longitude;
 }
 
-function getAndSendWeatherForecast(url) {
-  console.log(url);
-  weatherCommon.xhrRequest(url, 'GET',
-    function(responseText) {
-      // responseText contains a JSON object with weather info
-      var json = JSON.parse(responseText);
-
-      if(json.cod == "200") {
-        var forecast = extractFakeDailyForecast(json);
-
-        console.log('Forecast high/low temps are ' + forecast.highTemp + '/' + forecast.lowTemp);
-
-        // Conditions
-        var conditionCode = forecast.condition;
-        console.log('Forecast condition is ' + conditionCode);
-
-        var iconToLoad = getIconForConditionCode(conditionCode, false);
-
-        // Assemble dictionary using our keys
-        var dictionary = {
-          'KEY_FORECAST_CONDITION': iconToLoad,
-          'KEY_FORECAST_TEMP_HIGH': forecast.highTemp,
-          'KEY_FORECAST_TEMP_LOW': forecast.lowTemp
-        };
+function parseCurrentWeather(json) {
+  if(json.cod != "200") {
+    return null;
+  }
 
-        console.log(JSON.stringify(dictionary));
+  // night state
+  var isNight = (json.weather[0].icon.slice(-1) == 'n');
 
-        weatherCommon.sendWeatherToPebble(dictionary);
+  return {
+    current: {
+      temperature: json.main.temp,
+      condition: mapCondition(json.weather[0].id, isNight)
     }
-  });
-}
-
-function getIconForConditionCode(conditionCode, isNight) {
-  var generalCondition = Math.floor(conditionCode / 100);
-
-  // determine the correct icon
-  switch(generalCondition) {
-    case 2: //thunderstorm
-      iconToLoad = weatherCommon.icons.THUNDERSTORM;
-      break;
-    case 3: //drizzle
-      iconToLoad = weatherCommon.icons.LIGHT_RAIN;
-      break;
-    case 5: //rain
-      if(conditionCode == 500) {
-        iconToLoad = weatherCommon.icons.LIGHT_RAIN;
-      } else if(conditionCode < 505) {
-        iconToLoad = weatherCommon.icons.HEAVY_RAIN;
-      } else if(conditionCode == 511) {
-        iconToLoad = weatherCommon.icons.RAINING_AND_SNOWING;
-      } else {
-        iconToLoad = weatherCommon.icons.LIGHT_RAIN;
-      }
-      break;
-    case 6: //snow
-      if(conditionCode == 600 || conditionCode == 620) {
-        iconToLoad = weatherCommon.icons.LIGHT_SNOW;
-      } else if(conditionCode > 610 && conditionCode < 620) {
-        iconToLoad = weatherCommon.icons.RAINING_AND_SNOWING;
-      } else {
-        iconToLoad = weatherCommon.icons.HEAVY_SNOW;
-      }
-      break;
-    case 7: // fog, dust, etc
-      iconToLoad = weatherCommon.icons.CLOUDY_DAY;
-      break;
-    case 8: // clouds
-      if(conditionCode == 800) {
-        iconToLoad = (!isNight) ? weatherCommon.icons.CLEAR_DAY : weatherCommon.icons.CLEAR_NIGHT;
-      } else if(conditionCode < 803) {
-        iconToLoad = (!isNight) ? weatherCommon.icons.PARTLY_CLOUDY : weatherCommon.icons.PARTLY_CLOUDY_NIGHT;
-      } else {
-        iconToLoad = weatherCommon.icons.CLOUDY_DAY;
-      }
-      break;
-    default:
-      iconToLoad = weatherCommon.icons.WEATHER_GENERIC;
-      break;
-  }
-
-  return iconToLoad;
+  };
 }
 
 /*
- Attempts to approximate a daily forecast by interpolating the next
- 24 hours worth of 3 hour forecasts :-O
+ Turns the 3 hour forecasts into forecast points for the watch, which works
+ out the daily high/low and conditions from them by itself
 */
-function extractFakeDailyForecast(json) {
-  var todaysForecast = {};
-
-  // find the max and min of those temperatures
-  todaysForecast.highTemp = -Number.MAX_SAFE_INTEGER;
-  todaysForecast.lowTemp  = Number.MAX_SAFE_INTEGER;
+function parseForecast(json) {
+  if(json.cod != "200" || json.list.length === 0) {
+    return null;
+  }
 
-  for(var i = 0; i < json.list.length; i++) {
-    if(todaysForecast.highTemp < json.list[i].main.temp_max) {
-      todaysForecast.highTemp = json.list[i].main.temp_max;
-    }
+  var list = json.list;
+  var intervalMinutes = 180;
 
-    if(todaysForecast.lowTemp > json.list[i].main.temp_min) {
-      todaysForecast.lowTemp = json.list[i].main.temp_min;
-    }
+  if(list.length > 1) {
+    intervalMinutes = Math.round((list[1].dt - list[0].dt) / 60);
   }
 
-  // we can't really "average" conditions, so we'll just cheat and use...one of them :-O
-  todaysForecast.condition = json.list[3].weather[0].id;
+  var points = list.map(function(entry) {
+    var isNight = (entry.sys && entry.sys.pod == 'n');
+
+    return {
+      temp: entry.main.temp,
+      condition: mapCondition(entry.weather[0].id, isNight)
+    };
+  });
 
-  return todaysForecast;
+  return {
+    hourly: {
+      startTime: list[0].dt,
+      intervalMinutes: intervalMinutes,
+      points: points
+    }
+  };
 }
@@ -1,187 +1,103 @@
 var weatherCommon = require('weather');
 
-// "public" functions
-
-module.exports.getWeather = getWeather;
-module.exports.getWeatherFromCoords = getWeatherFromCoords;
-module.exports.getForecast = getForecast;
-module.exports.getForecastFromCoords = getForecastFromCoords;
-
-function getWeather(weatherLoc) {
-  var apiKey = window.localStorage.getItem('weather_api_key');
+var CONDITION_ICONS = {
+  'chanceflurries' : 'LIGHT_SNOW',
+  'chancerain'     : 'LIGHT_RAIN',
+  'chancesleet'    : 'RAINING_AND_SNOWING',
+  'chancesnow'     : 'LIGHT_SNOW',
+  'chancetstorms'  : 'THUNDERSTORM',
+  'clear'          : ['CLEAR_DAY', 'CLEAR_NIGHT'],
+  'cloudy'         : 'CLOUDY_DAY',
+  'flurries'       : 'LIGHT_SNOW',
+  'fog'            : 'CLOUDY_DAY',
+  'hazy'           : 'CLOUDY_DAY',
+  'mostlycloudy'   : 'CLOUDY_DAY',
+  'mostlysunny'    : ['CLEAR_DAY', 'CLEAR_NIGHT'],
+  'partlycloudy'   : ['PARTLY_CLOUDY', 'PARTLY_CLOUDY_NIGHT'],
+  'partlysunny'    : ['PARTLY_CLOUDY', 'PARTLY_CLOUDY_NIGHT'],
+  'sleet'          : 'RAINING_AND_SNOWING',
+  'rain'           : 'HEAVY_RAIN',
+  'snow'           : 'HEAVY_SNOW',
+  'sunny'          : ['CLEAR_DAY', 'CLEAR_NIGHT'],
+  'tstorms'        : 'THUNDERSTORM'
+};
 
-  var url = 'http://api.wunderground.com/api/' + apiKey +
-            '/conditions/q/' + encodeURIComponent(weatherLoc) + '.json';
+// "public" functions
 
-  getAndSendCurrentWeather(url);
-}
+module.exports.getRequests = getRequests;
+module.exports.mapCondition = mapCondition;
 
-function getWeatherFromCoords(pos) {
+// wunderground can return several features at once, so this is always one request
+function getRequests(location, wanted) {
   var apiKey = window.localStorage.getItem('weather_api_key');
+  var features = '';
+  var types = [];
 
-  // Construct URL
-  var url = 'http://api.wunderground.com/api/' + apiKey +
-            '/conditions/q/' + pos.coords.latitude + ',' + pos.coords.longitude + '.json';
-
-  getAndSendCurrentWeather(url);
-}
+  if(wanted.current) {
+    features += 'conditions/';
+    types.push('current');
+  }
 
-function getForecast(weatherLoc) {
-  var apiKey = window.localStorage.getItem('weather_api_key');
+  if(wanted.forecast) {
+    features += 'forecast/';
+    types.push('forecast');
+  }
 
-  var forecastURL = 'http://api.wunderground.com/api/' + apiKey +
-            '/forecast/q/' + encodeURIComponent(weatherLoc) + '.json';
+  var query = location.name ? encodeURIComponent(location.name) :
+              location.coords.latitude + ',' + location.coords.longitude;
 
-  getAndSendWeatherForecast(forecastURL);
+  return [{
+    url: 'http://api.wunderground.com/api/' + apiKey + '/' + features + 'q/' + query + '.json',
+    types: types,
+    parse: parseWeather
+  }];
 }
 
-function getForecastFromCoords(pos) {
-  var apiKey = window.localStorage.getItem('weather_api_key');
+function mapCondition(conditionCode, isNight) {
+  var icon = CONDITION_ICONS[conditionCode];
 
-  var forecastURL = 'http://api.wunderground.com/api/' + apiKey +
-            '/forecast/q/' + pos.coords.latitude + ',' + pos.coords.longitude + '.json';
+  if(icon === undefined) {
+    console.log("Warning: No icon found for " + conditionCode);
+  }
 
-  getAndSendWeatherForecast(forecastURL);
+  return weatherCommon.getIcon(icon, isNight);
 }
 
 // "private" functions
 
-// accepts a wunderground conditions url, gets weather data from it, and sends it to the watch
-function getAndSendCurrentWeather(url) {
-  weatherCommon.xhrRequest(url, 'GET',
-    function(responseText) {
-      // responseText contains a JSON object with weather info
-      var json = JSON.parse(responseText);
-
-      if(json.response.features.conditions == 1) {
-        var temperature = Math.round(json.current_observation.temp_c);
-        console.log('Temperature is ' + temperature);
-
-        // Conditions
-        var conditionCode = json.current_observation.icon;
-        console.log('Condition icon is ' + conditionCode);
-
-        // night state
-        var isNight = false;
-
-        if(!conditionCode.indexOf('nt_')) {
-          isNight = true;
-          conditionCode = conditionCode.slice(3);
-        }
-
-        var iconToLoad = getIconForConditionCode(conditionCode, isNight);
-        console.log('were loading this icon:' + iconToLoad);
-
-        // Assemble dictionary using our keys
-        var dictionary = {
-          'KEY_TEMPERATURE': temperature,
-          'KEY_CONDITION_CODE': iconToLoad
-        };
-
-        console.log(JSON.stringify(dictionary));
-
-        weatherCommon.sendWeatherToPebble(dictionary);
-      }
-  });
-}
-
-function getAndSendWeatherForecast(url) {
-  console.log(url);
-  weatherCommon.xhrRequest(url, 'GET',
-    function(responseText) {
-      // responseText contains a JSON object with weather info
-      var json = JSON.parse(responseText);
-
-      if(json.response.features.forecast == 1) {
-        var todaysForecast = json.forecast.simpleforecast.forecastday[0];
-
-        var highTemp = parseInt(todaysForecast.high.celsius, 10);
-        var lowTemp = parseInt(todaysForecast.low.celsius, 10);
+function parseWeather(json) {
+  if(!json.response || !json.response.features) {
+    return null;
+  }
 
-        console.log('Forecast high/low temps are ' + highTemp + '/' + lowTemp);
+  var result = {};
 
-        // Conditions
-        var conditionCode = todaysForecast.icon;
-        console.log('Forecast icon is ' + conditionCode);
+  if(json.response.features.conditions == 1) {
+    var conditionCode = json.current_observation.icon;
 
-        var iconToLoad = getIconForConditionCode(conditionCode, false);
+    // night state
+    var isNight = false;
 
-        // Assemble dictionary using our keys
-        var dictionary = {
-          'KEY_FORECAST_CONDITION': iconToLoad,
-          'KEY_FORECAST_TEMP_HIGH': highTemp,
-          'KEY_FORECAST_TEMP_LOW': lowTemp
-        };
+    if(!conditionCode.indexOf('nt_')) {
+      isNight = true;
+      conditionCode = conditionCode.slice(3);
+    }
 
-        console.log(JSON.stringify(dictionary));
+    result.current = {
+      temperature: json.current_observation.temp_c,
+      condition: mapCondition(conditionCode, isNight)
+    };
+  }
 
-        weatherCommon.sendWeatherToPebble(dictionary);
-    }
-  });
-}
+  if(json.response.features.forecast == 1) {
+    var todaysForecast = json.forecast.simpleforecast.forecastday[0];
 
-function getIconForConditionCode(conditionCode, isNight) {
-
-  // determine the correct icon
-  switch(conditionCode) {
-    case 'chanceflurries':
-      iconToLoad = weatherCommon.icons.LIGHT_SNOW;
-      break;
-    case 'chancerain':
-      iconToLoad = weatherCommon.icons.LIGHT_RAIN;
-      break;
-    case 'chancesleet':
-      iconToLoad = weatherCommon.icons.RAINING_AND_SNOWING;
-      break;
-    case 'chancesnow':
-      iconToLoad = weatherCommon.icons.LIGHT_SNOW;
-      break;
-    case 'chancetstorms':
-      iconToLoad = weatherCommon.icons.THUNDERSTORM;
-      break;
-    case 'clear':
-      iconToLoad = (!isNight) ? weatherCommon.icons.CLEAR_DAY : weatherCommon.icons.CLEAR_NIGHT;
-      break;
-    case 'cloudy':
-      iconToLoad = weatherCommon.icons.CLOUDY_DAY;
-      break;
-    case 'flurries':
-      iconToLoad = weatherCommon.icons.LIGHT_SNOW;
-      break;
-    case 'fog':
-    case 'hazy':
-    case 'mostlycloudy':
-      iconToLoad = weatherCommon.icons.CLOUDY_DAY;
-      break;
-    case 'mostlysunny':
-      iconToLoad = (!isNight) ? weatherCommon.icons.CLEAR_DAY : weatherCommon.icons.CLEAR_NIGHT;
-      break;
-    case 'partlycloudy':
-      iconToLoad = (!isNight) ? weatherCommon.icons.PARTLY_CLOUDY : weatherCommon.icons.PARTLY_CLOUDY_NIGHT;
-      break;
-    case 'partlysunny':
-      iconToLoad = (!isNight) ? weatherCommon.icons.PARTLY_CLOUDY : weatherCommon.icons.PARTLY_CLOUDY_NIGHT;
-      break;
-    case 'sleet':
-      iconToLoad = weatherCommon.icons.RAINING_AND_SNOWING;
-      break;
-    case 'rain':
-      iconToLoad = weatherCommon.icons.HEAVY_RAIN;
-      break;
-    case 'snow':
-      iconToLoad = weatherCommon.icons.HEAVY_SNOW;
-      break;
-    case 'sunny':
-      iconToLoad = (!isNight) ? weatherCommon.icons.CLEAR_DAY : weatherCommon.icons.CLEAR_NIGHT;
-      break;
-    case 'tstorms':
-      iconToLoad = weatherCommon.icons.THUNDERSTORM;
-      break;
-    default:
-      iconToLoad = weatherCommon.icons.WEATHER_GENERIC;
-      console.log("Warning: No icon found for " + conditionCode);
-      break;
+    result.daily = {
+      high: parseInt(todaysForecast.high.celsius, 10),
+      low: parseInt(todaysForecast.low.celsius, 10),
+      condition: mapCondition(todaysForecast.icon, false)
+    };
   }
 
-  return iconToLoad;
+  return result;
 }
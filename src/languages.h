@@ -1,4 +1,5 @@
 #pragma once
+#include <pebble.h>
 
 #define LANGUAGE_EN 0
 #define LANGUAGE_FR 1
@@ -34,12 +35,25 @@
 #define LANGUAGE_UK 31
 #define LANGUAGE_CY 32 // welsh
 
-/* day names in many different languages! */
-extern const char dayNames[33][7][8];
+/*
+ * The strings for one language. The LANGUAGES resource holds one of these
+ * for each language id above, generated by tools/localDates.py, so the
+ * layout has to match the one there
+ */
+typedef struct {
+  char dayNames[7][8];
+  char monthNames[12][8];
 
-/* month names in many different languages! */
-extern const char monthNames[33][12][8];
+  // all of these are taken from:
+  // http://www.unicode.org/cldr/charts/28/by_type/date_&_time.fields.html#521165cf49647551
+  char wordForWeek[12];
+} LanguageStrings;
 
-// all of these are taken from:
-// http://www.unicode.org/cldr/charts/28/by_type/date_&_time.fields.html#521165cf49647551
-extern const char wordForWeek[33][12];
+/* the strings for the language that was loaded last */
+extern LanguageStrings Languages_current;
+
+/*
+ * Loads the strings for the language from the LANGUAGES resource, unless
+ * they're loaded already
+ */
+void Languages_load(uint8_t languageId);
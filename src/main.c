@@ -5,6 +5,12 @@
 #include "weather.h"
 #include "sidebar.h"
 #include "util.h"
+#include "tick_scheduler.h"
+#include "telemetry.h"
+#include "storage.h"
+#include "benchmark.h"
+#include "replay.h"
+#include "golden.h"
 
 // windows and layers
 static Window* mainWindow;
@@ -13,16 +19,33 @@ static Layer* windowLayer;
 // current bluetooth state
 static bool isPhoneConnected;
 
-// current time service subscription
-static bool updatingEverySecond;
-
 // the four digits on the clock, ordered h1 h2, m1 m2
 static ClockDigit clockDigits[4];
 
 // try to randomize when watches call the weather API
 static uint8_t weatherRefreshMinute;
 
+// the unobstructed area service only exists on newer SDKs
+#ifdef PBL_API_EXISTS
+  #if PBL_API_EXISTS(unobstructed_area_service_subscribe)
+    #define HAS_UNOBSTRUCTED_AREA
+  #endif
+#endif
+
+// what's covering the watchface, if anything. Nothing is drawn while covered
+typedef enum {
+  COVERED_BY_APP        = 1 << 0, // a notification or another app has focus
+  COVERED_BY_ANIMATION  = 1 << 1  // the unobstructed area is changing
+} CoveredReason;
+
+static uint8_t coveredBy;
+
+// what was missed while covered, caught up on when uncovered
+static bool clockPending;
+static uint8_t pendingChanges;
+
 void update_clock();
+void updateScreen(uint8_t changed);
 void redrawScreen();
 void tick_handler(struct tm *tick_time, TimeUnits units_changed);
 void bluetoothStateChanged(bool newConnectionState);
@@ -55,71 +78,79 @@ void update_clock() {
     }
   }
 
-  uint8_t current_font = globalSettings.clockFontId;
+  uint8_t hour_font = globalSettings.clockFontId;
+  uint8_t minute_font = globalSettings.clockFontId;
 
   if(globalSettings.clockFontId == FONT_SETTING_BOLD_H) {
-    current_font = FONT_SETTING_BOLD;
+    hour_font = FONT_SETTING_BOLD;
+    minute_font = FONT_SETTING_DEFAULT;
   } else if(globalSettings.clockFontId == FONT_SETTING_BOLD_M) {
-    current_font = FONT_SETTING_DEFAULT;
+    hour_font = FONT_SETTING_DEFAULT;
+    minute_font = FONT_SETTING_BOLD;
   }
 
+  // make sure the digit images for both fonts are ready to go
+  ClockDigit_setActiveFonts((1 << hour_font) | (1 << minute_font));
+
   // use the blank image for the leading hour digit if needed
   if(globalSettings.showLeadingZero || hour / 10 != 0) {
-    ClockDigit_setNumber(&clockDigits[0], hour / 10, current_font);
+    ClockDigit_setNumber(&clockDigits[0], hour / 10, hour_font);
   } else {
     ClockDigit_setBlank(&clockDigits[0]);
   }
 
-  ClockDigit_setNumber(&clockDigits[1], hour % 10, current_font);
+  ClockDigit_setNumber(&clockDigits[1], hour % 10, hour_font);
 
-  if(globalSettings.clockFontId == FONT_SETTING_BOLD_H) {
-    current_font = FONT_SETTING_DEFAULT;
-  } else if(globalSettings.clockFontId == FONT_SETTING_BOLD_M) {
-    current_font = FONT_SETTING_BOLD;
-  }
-
-  ClockDigit_setNumber(&clockDigits[2], timeInfo->tm_min  / 10, current_font);
-  ClockDigit_setNumber(&clockDigits[3], timeInfo->tm_min  % 10, current_font);
+  ClockDigit_setNumber(&clockDigits[2], timeInfo->tm_min  / 10, minute_font);
+  ClockDigit_setNumber(&clockDigits[3], timeInfo->tm_min  % 10, minute_font);
 
   Sidebar_updateTime(timeInfo);
 }
 
-/* forces everything on screen to be redrawn -- perfect for keeping track of settings! */
-void redrawScreen() {
+/* redoes only the work for what changed, given as RedrawFlags */
+void updateScreen(uint8_t changed) {
+  // nobody would see it, so do it all at once later
+  if(coveredBy) {
+    pendingChanges |= changed;
+    return;
+  }
 
   // check if the tick handler frequency should be changed
-  if(globalSettings.updateScreenEverySecond != updatingEverySecond) {
-    tick_timer_service_unsubscribe();
-
-    if(globalSettings.updateScreenEverySecond) {
-      tick_timer_service_subscribe(SECOND_UNIT, tick_handler);
-      updatingEverySecond = true;
-    } else {
-      tick_timer_service_subscribe(MINUTE_UNIT, tick_handler);
-      updatingEverySecond = false;
-    }
+  if(changed & REDRAW_TICK_RATE) {
+    TickScheduler_update();
   }
 
-  // maybe the colors changed!
-  for(int i = 0; i < 4; i++) {
-    ClockDigit_setColor(&clockDigits[i], globalSettings.timeColor, globalSettings.timeBgColor);
-    // ClockDigit_setColor(&clockDigits[i], globalSettings.timeColor, GColorWhite);
+  if(changed & REDRAW_COLORS) {
+    ClockDigit_setColors(globalSettings.timeColor, globalSettings.timeBgColor);
+
+    window_set_background_color(mainWindow, globalSettings.timeBgColor);
   }
 
-  window_set_background_color(mainWindow, globalSettings.timeBgColor);
+  // the sidebar position may have changed
+  if(changed & REDRAW_LAYOUT) {
+    int digitOffset = (globalSettings.sidebarOnLeft) ? 30 : 0;
 
-  // or maybe the sidebar position changed!
-  int digitOffset = (globalSettings.sidebarOnLeft) ? 30 : 0;
+    for(int i = 0; i < 4; i++) {
+      ClockDigit_offsetPosition(&clockDigits[i], digitOffset);
+    }
+  }
 
-  for(int i = 0; i < 4; i++) {
-    ClockDigit_offsetPosition(&clockDigits[i], digitOffset);
+  // the digits, or the strings the widgets show, need to be made again
+  if(changed & (REDRAW_FONT | REDRAW_LANGUAGE | REDRAW_LAYOUT)) {
+    update_clock();
   }
 
-  // maybe the language changed!
-  update_clock();
+  if(changed & (REDRAW_COLORS | REDRAW_LAYOUT | REDRAW_LANGUAGE)) {
+    Sidebar_redraw();
+  } else if(changed & REDRAW_WEATHER) {
+    // nothing but the weather widgets needs to know
+    Sidebar_invalidate(WIDGET_INPUT_WEATHER);
+  }
+}
 
-  // update the sidebar
-  Sidebar_redraw();
+/* forces everything on screen to be redrawn */
+void redrawScreen() {
+  updateScreen(REDRAW_ALL);
 }
 
 static void main_window_load(Window *window) {
@@ -130,13 +161,14 @@ static void main_window_load(Window *window) {
     GPoint digitPoints[4] = {GPoint(7, 7), GPoint(60, 7), GPoint(7, 90), GPoint(60, 90)};
   #endif
 
+  ClockDigit_setColors(globalSettings.timeColor, globalSettings.timeBgColor);
+
   ClockDigit_construct(&clockDigits[0], digitPoints[0]);
   ClockDigit_construct(&clockDigits[1], digitPoints[1]);
   ClockDigit_construct(&clockDigits[2], digitPoints[2]);
   ClockDigit_construct(&clockDigits[3], digitPoints[3]);
 
   for(int i = 0; i < 4; i++) {
-    ClockDigit_setColor(&clockDigits[i], globalSettings.timeColor, globalSettings.timeBgColor);
     layer_add_child(window_get_root_layer(window), bitmap_layer_get_layer(clockDigits[i].imageLayer));
   }
 
@@ -148,6 +180,10 @@ static void main_window_load(Window *window) {
   // Make sure the time is displayed from the start
   redrawScreen();
   update_clock();
+
+  #ifdef TIMESTYLE_BENCHMARK
+    Benchmark_start(window_get_root_layer(window), redrawScreen);
+  #endif
 }
 
 static void main_window_unload(Window *window) {
@@ -155,18 +191,29 @@ static void main_window_unload(Window *window) {
     ClockDigit_destruct(&clockDigits[i]);
   }
 
+  ClockDigit_freeAtlas();
+
   Sidebar_deinit();
 }
 
 void tick_handler(struct tm *tick_time, TimeUnits units_changed) {
+  Telemetry_tickStarted(tick_time);
 
   // every 30 minutes, request new weather data
   if(!globalSettings.disableWeather) {
-    if(tick_time->tm_min == weatherRefreshMinute && tick_time->tm_sec == 0) {
+    // as long as the hourly forecast has enough left in it, there's no need
+    // to wake up the phone
+    if(tick_time->tm_min == weatherRefreshMinute && tick_time->tm_sec == 0 &&
+       Weather_needsRefresh(time(NULL))) {
       messaging_requestNewWeatherData();
     }
   }
 
+  // move through the hourly forecast as time passes
+  if(tick_time->tm_sec == 0 && Weather_advanceHourlyForecast(time(NULL))) {
+    Sidebar_invalidate(WIDGET_INPUT_WEATHER);
+  }
+
   // every hour, if requested, vibrate
   if(tick_time->tm_sec == 0) {
     if(globalSettings.hourlyVibe == 1) { // hourly vibes only
@@ -182,7 +229,13 @@ void tick_handler(struct tm *tick_time, TimeUnits units_changed) {
     }
   }
 
-  update_clock();
+  if(coveredBy) {
+    clockPending = true;
+  } else {
+    update_clock();
+  }
+
+  Telemetry_tickFinished();
 }
 
 void bluetoothStateChanged(bool newConnectionState) {
@@ -197,19 +250,67 @@ void bluetoothStateChanged(bool newConnectionState) {
     vibes_enqueue_custom_pattern(pat);
   }
 
-  // if the phone was disconnected and isn't anymore, update the data
-  if(!isPhoneConnected && newConnectionState) {
+  // if the phone was disconnected and isn't anymore, update the data if
+  // it's getting old (a flapping connection gets deduped by messaging)
+  if(!isPhoneConnected && newConnectionState &&
+     !globalSettings.disableWeather && Weather_needsRefresh(time(NULL))) {
     messaging_requestNewWeatherData();
   }
 
   isPhoneConnected = newConnectionState;
 
-  Sidebar_redraw();
+  Sidebar_invalidate(WIDGET_INPUT_BLUETOOTH);
+
+  // the disconnection icon may have covered or uncovered the seconds
+  TickScheduler_update();
 }
 
-// force the sidebar to redraw any time the battery state changes
+// redraw the sidebar any time the battery state changes, if it's shown
 void batteryStateChanged(BatteryChargeState charge_state) {
-  Sidebar_redraw();
+  Sidebar_invalidate(WIDGET_INPUT_BATTERY);
+
+  // same goes for the auto battery widget
+  TickScheduler_update();
+}
+
+/*
+ * Starts or stops the covering of the watchface for one reason. While covered,
+ * ticks and changes are only remembered, and uncovering catches up on all of
+ * them in a single render
+ */
+static void setCovered(CoveredReason reason, bool covered) {
+  uint8_t wasCoveredBy = coveredBy;
+
+  if(covered) {
+    coveredBy |= reason;
+  } else {
+    coveredBy &= ~reason;
+  }
+
+  // no need to tick every second while another app covers the screen, but
+  // a moving obstruction is gone again too soon to be worth it
+  TickScheduler_setFocused(!(coveredBy & COVERED_BY_APP));
+
+  if(!wasCoveredBy == !coveredBy) {
+    return;
+  }
+
+  Sidebar_setPaused(coveredBy != 0);
+
+  if(!coveredBy) {
+    uint8_t changes = pendingChanges;
+    pendingChanges = 0;
+
+    // updateScreen makes the clock again for some of the changes
+    if(clockPending && !(changes & (REDRAW_FONT | REDRAW_LANGUAGE | REDRAW_LAYOUT))) {
+      update_clock();
+    }
+
+    clockPending = false;
+    updateScreen(changes);
+
+    layer_mark_dirty(windowLayer);
+  }
 }
 
 // fixes for disappearing elements after notifications
@@ -225,8 +326,21 @@ static void app_focus_changed(bool focused) {
      layer_set_hidden(windowLayer, false);
      layer_mark_dirty(windowLayer);
   }
+
+  setCovered(COVERED_BY_APP, !focused);
 }
 
+#ifdef HAS_UNOBSTRUCTED_AREA
+  // Timeline Quick View sliding in or out: skip the frames in between
+  static void unobstructed_will_change(GRect final_unobstructed_screen_area, void *context) {
+    setCovered(COVERED_BY_ANIMATION, true);
+  }
+
+  static void unobstructed_did_change(void *context) {
+    setCovered(COVERED_BY_ANIMATION, false);
+  }
+#endif
+
 static void init() {
   setlocale(LC_ALL, "");
 
@@ -234,6 +348,13 @@ static void init() {
 
   weatherRefreshMinute = rand() % 60;
 
+  #ifdef TIMESTYLE_REPLAY
+    // the same refresh minute every time, so that replays can be compared
+    weatherRefreshMinute = 0;
+  #endif
+
+  Telemetry_init();
+
   // init settings
   Settings_init();
 
@@ -241,7 +362,7 @@ static void init() {
   Weather_init();
 
   // init the messaging thing
-  messaging_init(redrawScreen);
+  messaging_init(updateScreen);
 
   // Create main Window element and assign to pointer
   mainWindow = window_create();
@@ -257,14 +378,8 @@ static void init() {
 
   windowLayer = window_get_root_layer(mainWindow);
 
-  // Register with TickTimerService
-  if(globalSettings.updateScreenEverySecond) {
-    tick_timer_service_subscribe(SECOND_UNIT, tick_handler);
-    updatingEverySecond = true;
-  } else {
-    tick_timer_service_subscribe(MINUTE_UNIT, tick_handler);
-    updatingEverySecond = false;
-  }
+  // Register with TickTimerService, at whatever rate the widgets need
+  TickScheduler_init(tick_handler);
 
   bool connected = bluetooth_connection_service_peek();
   bluetoothStateChanged(connected);
@@ -278,6 +393,27 @@ static void init() {
     .did_focus = app_focus_changed,
     .will_focus = app_focus_changing
   });
+
+  #ifdef HAS_UNOBSTRUCTED_AREA
+    unobstructed_area_service_subscribe((UnobstructedAreaHandlers){
+      .will_change = unobstructed_will_change,
+      .did_change = unobstructed_did_change
+    }, NULL);
+  #endif
+
+  #if defined(TIMESTYLE_GOLDEN)
+    Golden_start(windowLayer, redrawScreen);
+  #elif defined(TIMESTYLE_REPLAY)
+    Replay_start((ReplayHandlers){
+      .tick = tick_handler,
+      .bluetooth = bluetoothStateChanged,
+      .battery = batteryStateChanged,
+      .focus = {
+        .did_focus = app_focus_changed,
+        .will_focus = app_focus_changing
+      }
+    }, redrawScreen);
+  #endif
 }
 
 static void deinit() {
@@ -288,8 +424,16 @@ static void deinit() {
   Weather_deinit();
   Settings_deinit();
 
+  // write out anything that's still waiting
+  Storage_deinit();
+
+  TickScheduler_deinit();
   bluetooth_connection_service_unsubscribe();
   battery_state_service_unsubscribe();
+
+  #ifdef HAS_UNOBSTRUCTED_AREA
+    unobstructed_area_service_unsubscribe();
+  #endif
 }
 
 int main(void) {
@@ -2,18 +2,142 @@
 #include "weather.h"
 #include "settings.h"
 #include "messaging.h"
+#include "telemetry.h"
+#include "replay.h"
+
+void (*message_processed_callback)(uint8_t changed);
+
+// when we last asked for weather, so that bursts of requests are merged
+time_t messaging_lastWeatherRequest = 0;
+
+// the parts of an incoming message, which are only acted on once they've all been read
+typedef enum {
+  INBOX_TEMPERATURE         = 1 << 0,
+  INBOX_CONDITION           = 1 << 1,
+  INBOX_FORECAST_CONDITION  = 1 << 2,
+  INBOX_FORECAST_HIGH       = 1 << 3,
+  INBOX_FORECAST_LOW        = 1 << 4,
+  INBOX_HOURLY              = 1 << 5,
+  INBOX_SETTINGS            = 1 << 6,
+  INBOX_TELEMETRY_DUMP      = 1 << 7
+} InboxPart;
+
+// the weather only changes once every part of it has arrived
+#define INBOX_CURRENT_WEATHER (INBOX_TEMPERATURE | INBOX_CONDITION)
+#define INBOX_FORECAST (INBOX_FORECAST_CONDITION | INBOX_FORECAST_HIGH | INBOX_FORECAST_LOW)
+
+typedef enum {
+  INBOX_TYPE_ANY,
+  INBOX_TYPE_INT,  // signed or unsigned, of any width
+  INBOX_TYPE_DATA
+} InboxType;
+
+/*
+ * How to read the tuple with a given key: the type it must have, where to
+ * put its value and which part of the message it is
+ */
+typedef struct {
+  InboxType type;
+  void (*read)(const Tuple* tuple);
+  uint16_t received;
+} InboxKey;
+
+// the values read from the message being processed
+typedef struct {
+  int temperature;
+  int conditionCode;
+  int forecastCondition;
+  int forecastHigh;
+  int forecastLow;
+  const uint8_t* hourlyData;
+  uint16_t hourlyLength;
+  const uint8_t* settingsData;
+  uint16_t settingsLength;
+} InboxMessage;
+
+InboxMessage messaging_inbox;
+
+int readInt(const Tuple* tuple) {
+  switch(tuple->length) {
+    case 1:
+      return (tuple->type == TUPLE_INT) ? tuple->value->int8 : tuple->value->uint8;
+    case 2:
+      return (tuple->type == TUPLE_INT) ? tuple->value->int16 : tuple->value->uint16;
+    default:
+      return tuple->value->int32;
+  }
+}
+
+bool tupleHasType(const Tuple* tuple, InboxType type) {
+  switch(type) {
+    case INBOX_TYPE_INT:
+      return tuple->type == TUPLE_INT || tuple->type == TUPLE_UINT;
+    case INBOX_TYPE_DATA:
+      return tuple->type == TUPLE_BYTE_ARRAY;
+    default:
+      return true;
+  }
+}
+
+void readTemperature(const Tuple* tuple)       { messaging_inbox.temperature = readInt(tuple); }
+void readCondition(const Tuple* tuple)         { messaging_inbox.conditionCode = readInt(tuple); }
+void readForecastCondition(const Tuple* tuple) { messaging_inbox.forecastCondition = readInt(tuple); }
+void readForecastHigh(const Tuple* tuple)      { messaging_inbox.forecastHigh = readInt(tuple); }
+void readForecastLow(const Tuple* tuple)       { messaging_inbox.forecastLow = readInt(tuple); }
+
+void readHourly(const Tuple* tuple) {
+  messaging_inbox.hourlyData = tuple->value->data;
+  messaging_inbox.hourlyLength = tuple->length;
+}
 
-void (*message_processed_callback)(void);
+void readSettings(const Tuple* tuple) {
+  messaging_inbox.settingsData = tuple->value->data;
+  messaging_inbox.settingsLength = tuple->length;
+}
+
+// nothing to read, the key itself is the request
+void readTelemetryDump(const Tuple* tuple) { }
+
+// indexed by the appKeys in appinfo.json. Keys without a reader are ignored
+const InboxKey messaging_inboxKeys[KEY_WEATHER_HOURLY + 1] = {
+  [KEY_TEMPERATURE]        = { INBOX_TYPE_INT,  readTemperature,       INBOX_TEMPERATURE },
+  [KEY_CONDITION_CODE]     = { INBOX_TYPE_INT,  readCondition,         INBOX_CONDITION },
+  [KEY_FORECAST_CONDITION] = { INBOX_TYPE_INT,  readForecastCondition, INBOX_FORECAST_CONDITION },
+  [KEY_FORECAST_TEMP_HIGH] = { INBOX_TYPE_INT,  readForecastHigh,      INBOX_FORECAST_HIGH },
+  [KEY_FORECAST_TEMP_LOW]  = { INBOX_TYPE_INT,  readForecastLow,       INBOX_FORECAST_LOW },
+  [KEY_TELEMETRY_DUMP]     = { INBOX_TYPE_ANY,  readTelemetryDump,     INBOX_TELEMETRY_DUMP },
+  [KEY_SETTINGS]           = { INBOX_TYPE_DATA, readSettings,          INBOX_SETTINGS },
+  [KEY_WEATHER_HOURLY]     = { INBOX_TYPE_DATA, readHourly,            INBOX_HOURLY },
+};
 
 void messaging_requestNewWeatherData() {
+  // nobody would hear us
+  if(!bluetooth_connection_service_peek()) {
+    return;
+  }
+
+  time_t now = time(NULL);
+
+  if(messaging_lastWeatherRequest != 0 && now - messaging_lastWeatherRequest < WEATHER_REQUEST_MIN_INTERVAL) {
+    return;
+  }
+
   // just send an empty message for now
   DictionaryIterator *iter;
-  app_message_outbox_begin(&iter);
+
+  if(app_message_outbox_begin(&iter) != APP_MSG_OK) {
+    return;
+  }
+
   dict_write_uint32(iter, 0, 0);
-  app_message_outbox_send();
+
+  // only a request that went out holds off the next one
+  if(app_message_outbox_send() == APP_MSG_OK) {
+    messaging_lastWeatherRequest = now;
+  }
 }
 
-void messaging_init(void (*processed_callback)(void)) {
+void messaging_init(void (*processed_callback)(uint8_t changed)) {
   // register my custom callback
   message_processed_callback = processed_callback;
 
@@ -24,184 +148,111 @@ void messaging_init(void (*processed_callback)(void)) {
   app_message_register_outbox_sent(outbox_sent_callback);
 
   // Open AppMessage
-  #ifdef PBL_COLOR
-  app_message_open(512, 8);
-  #else
-  app_message_open(256, 8); //leave a bit of extra headroom on watches with more RAM
-  #endif
+  // settings arrive as a compact blob, so the inbox only needs to fit that
+  // or the weather. The outbox only needs to fit a single telemetry sample
+  app_message_open(128, 80);
 
   // APP_LOG(APP_LOG_LEVEL_DEBUG, "Watch messaging is started!");
   app_message_register_inbox_received(inbox_received_callback);
 }
 
 void inbox_received_callback(DictionaryIterator *iterator, void *context) {
-  // does this message contain current weather conditions?
-  Tuple *weatherTemp_tuple = dict_find(iterator, KEY_TEMPERATURE);
-  Tuple *weatherConditions_tuple = dict_find(iterator, KEY_CONDITION_CODE);
+  Telemetry_countMessage(TELEMETRY_INBOX_RECEIVED);
 
-  if(weatherTemp_tuple != NULL && weatherConditions_tuple != NULL) {
-    // now set the weather conditions properly
-    Weather_weatherInfo.currentTemp = (int)weatherTemp_tuple->value->int32;
-
-    Weather_setCurrentCondition(weatherConditions_tuple->value->int32);
-
-    Weather_saveData();
-  }
+  // read every tuple once, remembering which parts of the message arrived
+  uint16_t received = 0;
 
-  // does this message contain weather forecast information?
-  Tuple *weatherForecastCondition_tuple = dict_find(iterator, KEY_FORECAST_CONDITION);
-  Tuple *weatherForecastHigh_tuple = dict_find(iterator, KEY_FORECAST_TEMP_HIGH);
-  Tuple *weatherForecastLow_tuple = dict_find(iterator, KEY_FORECAST_TEMP_LOW);
+  for(Tuple* tuple = dict_read_first(iterator); tuple != NULL; tuple = dict_read_next(iterator)) {
+    if(tuple->key >= ARRAY_LENGTH(messaging_inboxKeys)) {
+      continue;
+    }
 
-  if(weatherForecastCondition_tuple != NULL && weatherForecastHigh_tuple != NULL
-     && weatherForecastLow_tuple != NULL) {
+    const InboxKey* inboxKey = &messaging_inboxKeys[tuple->key];
 
-    Weather_weatherForecast.highTemp = (int)weatherForecastHigh_tuple->value->int32;
-    Weather_weatherForecast.lowTemp = (int)weatherForecastLow_tuple->value->int32;
-    Weather_setForecastCondition(weatherForecastCondition_tuple->value->int32);
+    if(inboxKey->read == NULL || !tupleHasType(tuple, inboxKey->type)) {
+      continue;
+    }
 
-    Weather_saveData();
-  }
-
-  // does this message contain new config information?
-  Tuple *timeColor_tuple = dict_find(iterator, KEY_SETTING_COLOR_TIME);
-  Tuple *bgColor_tuple = dict_find(iterator, KEY_SETTING_COLOR_BG);
-  Tuple *sidebarColor_tuple = dict_find(iterator, KEY_SETTING_COLOR_SIDEBAR);
-  Tuple *sidebarPos_tuple = dict_find(iterator, KEY_SETTING_SIDEBAR_LEFT);
-  Tuple *sidebarTextColor_tuple = dict_find(iterator, KEY_SETTING_SIDEBAR_TEXT_COLOR);
-  Tuple *useMetric_tuple = dict_find(iterator, KEY_SETTING_USE_METRIC);
-  Tuple *btVibe_tuple = dict_find(iterator, KEY_SETTING_BT_VIBE);
-  Tuple *language_tuple = dict_find(iterator, KEY_SETTING_LANGUAGE_ID);
-  Tuple *leadingZero_tuple = dict_find(iterator, KEY_SETTING_SHOW_LEADING_ZERO);
-  Tuple *batteryPct_tuple = dict_find(iterator, KEY_SETTING_SHOW_BATTERY_PCT);
-  Tuple *disableWeather_tuple = dict_find(iterator, KEY_SETTING_DISABLE_WEATHER);
-  Tuple *clockFont_tuple = dict_find(iterator, KEY_SETTING_CLOCK_FONT_ID);
-  Tuple *hourlyVibe_tuple = dict_find(iterator, KEY_SETTING_HOURLY_VIBE);
-  Tuple *useLargeFonts_tuple = dict_find(iterator, KEY_SETTING_USE_LARGE_FONTS);
-
-  Tuple *widget0Id_tuple = dict_find(iterator, KEY_WIDGET_0_ID);
-  Tuple *widget1Id_tuple = dict_find(iterator, KEY_WIDGET_1_ID);
-  Tuple *widget2Id_tuple = dict_find(iterator, KEY_WIDGET_2_ID);
-
-  Tuple *altclockName_tuple = dict_find(iterator, KEY_SETTING_ALTCLOCK_NAME);
-  Tuple *altclockOffset_tuple = dict_find(iterator, KEY_SETTING_ALTCLOCK_OFFSET);
-
-  Tuple *decimalSeparator_tuple = dict_find(iterator, KEY_SETTING_DECIMAL_SEPARATOR);
-  Tuple *healthUseDistance_tuple = dict_find(iterator, KEY_SETTING_HEALTH_USE_DISTANCE);
-  Tuple *healthUseRestfulSleep_tuple = dict_find(iterator, KEY_SETTING_HEALTH_USE_RESTFUL_SLEEP);
-
-  Tuple *autobattery_tuple = dict_find(iterator, KEY_SETTING_DISABLE_AUTOBATTERY);
-
-
-  if(timeColor_tuple != NULL) {
-    globalSettings.timeColor = GColorFromHEX(timeColor_tuple->value->int32);
+    inboxKey->read(tuple);
+    received |= inboxKey->received;
   }
 
-  if(bgColor_tuple != NULL) {
-    globalSettings.timeBgColor = GColorFromHEX(bgColor_tuple->value->int32);
-  }
+  // then update each thing that changed, once
+  bool weatherChanged = false;
+  uint8_t changed = 0;
 
-  if(sidebarColor_tuple != NULL) {
-    globalSettings.sidebarColor = GColorFromHEX(sidebarColor_tuple->value->int32);
+  if((received & INBOX_CURRENT_WEATHER) == INBOX_CURRENT_WEATHER) {
+    Weather_weatherInfo.currentTemp = messaging_inbox.temperature;
+    Weather_setCurrentCondition(messaging_inbox.conditionCode);
+    weatherChanged = true;
   }
 
-  if(sidebarTextColor_tuple != NULL) {
-    // text can only be black or white, so we'll enforce that here
-    globalSettings.sidebarTextColor = GColorFromHEX(sidebarTextColor_tuple->value->int32);
+  if((received & INBOX_FORECAST) == INBOX_FORECAST) {
+    Weather_weatherForecast.highTemp = messaging_inbox.forecastHigh;
+    Weather_weatherForecast.lowTemp = messaging_inbox.forecastLow;
+    Weather_setForecastCondition(messaging_inbox.forecastCondition);
+    weatherChanged = true;
   }
 
-  if(sidebarPos_tuple != NULL) {
-    globalSettings.sidebarOnLeft = (bool)sidebarPos_tuple->value->int8;
+  if(received & INBOX_HOURLY) {
+    Weather_setHourlyForecast(messaging_inbox.hourlyData, messaging_inbox.hourlyLength);
+    weatherChanged = true;
+  } else if(weatherChanged) {
+    // no hourly data with it, so whatever's left of the old hourly forecast
+    // (say, from another provider) mustn't take over from this
+    Weather_clearHourlyForecast();
   }
 
-  if(useMetric_tuple != NULL) {
-    globalSettings.useMetric = (bool)useMetric_tuple->value->int8;
-  }
-
-  if(btVibe_tuple != NULL) {
-    globalSettings.btVibe = (bool)btVibe_tuple->value->int8;
-  }
-
-  if(leadingZero_tuple != NULL) {
-    globalSettings.showLeadingZero = (bool)leadingZero_tuple->value->int8;
-  }
-
-  if(batteryPct_tuple != NULL) {
-    globalSettings.showBatteryPct = (bool)batteryPct_tuple->value->int8;
-  }
-
-  if(autobattery_tuple != NULL) {
-    globalSettings.disableAutobattery = (bool)autobattery_tuple->value->int8;
-  }
-
-  if(disableWeather_tuple != NULL) {
-    globalSettings.disableWeather = (bool)disableWeather_tuple->value->int8;
-  }
-
-  if(clockFont_tuple != NULL) {
-    globalSettings.clockFontId = clockFont_tuple->value->int8;
-  }
-
-  if(useLargeFonts_tuple != NULL) {
-    globalSettings.useLargeFonts = (bool)useLargeFonts_tuple->value->int8;
-  }
-
-  if(hourlyVibe_tuple != NULL) {
-    globalSettings.hourlyVibe = hourlyVibe_tuple->value->int8;
-  }
-
-  if(language_tuple != NULL) {
-    globalSettings.languageId = language_tuple->value->int8;
-  }
-
-  if(widget0Id_tuple != NULL) {
-    globalSettings.widgets[0] = widget0Id_tuple->value->int8;
-  }
-
-  if(widget1Id_tuple != NULL) {
-    globalSettings.widgets[1] = widget1Id_tuple->value->int8;
-  }
-
-  if(widget2Id_tuple != NULL) {
-    globalSettings.widgets[2] = widget2Id_tuple->value->int8;
-  }
-
-  if(altclockName_tuple != NULL) {
-    strncpy(globalSettings.altclockName, altclockName_tuple->value->cstring, sizeof(globalSettings.altclockName));
+  if(weatherChanged) {
+    Weather_saveData();
+    changed |= REDRAW_WEATHER;
   }
 
-  if(altclockOffset_tuple != NULL) {
-    globalSettings.altclockOffset = altclockOffset_tuple->value->int8;
-  }
+  if(received & INBOX_SETTINGS) {
+    // even settings that don't show, like the vibrations, need saving
+    if(Settings_applyBlob(messaging_inbox.settingsData, messaging_inbox.settingsLength, &changed)) {
+      // save the new settings to persistent storage
+      Settings_saveToStorage();
 
-  if(decimalSeparator_tuple != NULL) {
-    globalSettings.decimalSeparator = (char)decimalSeparator_tuple->value->int8;
+      // load or free icons for the widgets now in use
+      SidebarWidgets_updateLoadedIcons();
+    }
   }
 
-  if(healthUseDistance_tuple != NULL) {
-    globalSettings.healthUseDistance = (bool)healthUseDistance_tuple->value->int8;
+  // let the main screen redo whatever is affected
+  if(changed) {
+    message_processed_callback(changed);
   }
 
-  if(healthUseRestfulSleep_tuple != NULL) {
-    globalSettings.healthUseRestfulSleep = (bool)healthUseRestfulSleep_tuple->value->int8;
+  // is the phone asking for the telemetry buffer?
+  if(received & INBOX_TELEMETRY_DUMP) {
+    Telemetry_startDump();
   }
-
-  // save the new settings to persistent storage
-  Settings_saveToStorage();
-
-  // notify the main screen, in case something changed
-  message_processed_callback();
 }
 
 void inbox_dropped_callback(AppMessageResult reason, void *context) {
+  Telemetry_countMessage(TELEMETRY_INBOX_DROPPED);
   // APP_LOG(APP_LOG_LEVEL_ERROR, "Message dropped!");
 }
 
 void outbox_failed_callback(DictionaryIterator *iterator, AppMessageResult reason, void *context) {
   // APP_LOG(APP_LOG_LEVEL_ERROR, "Outbox send failed! %d %d %d", reason, APP_MSG_SEND_TIMEOUT, APP_MSG_SEND_REJECTED);
+  Telemetry_countMessage(TELEMETRY_OUTBOX_FAILED);
 
+  // don't keep dumping telemetry into a connection that isn't working
+  Telemetry_cancelDump();
+
+  // a lost weather request (the only message with key 0) can be retried
+  // straight away, instead of after the whole request interval
+  if(dict_find(iterator, 0) != NULL) {
+    messaging_lastWeatherRequest = 0;
+  }
 }
 
 void outbox_sent_callback(DictionaryIterator *iterator, void *context) {
   // APP_LOG(APP_LOG_LEVEL_INFO, "Outbox send success!");
+  Telemetry_countMessage(TELEMETRY_OUTBOX_SENT);
+
+  // if we're sending the telemetry buffer, send the next sample
+  Telemetry_continueDump();
 }
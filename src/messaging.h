@@ -4,36 +4,33 @@
 #define KEY_TEMPERATURE                 3
 #define KEY_CONDITION_CODE              4
 #define KEY_USE_NIGHT_ICON              5
-#define KEY_SETTING_COLOR_TIME          6
-#define KEY_SETTING_COLOR_BG            7
-#define KEY_SETTING_COLOR_SIDEBAR       8
-#define KEY_SETTING_SIDEBAR_LEFT        9
-#define KEY_SETTING_USE_METRIC          10
-#define KEY_SETTING_BT_VIBE             11
-#define KEY_SETTING_SIDEBAR_TEXT_COLOR  12
-#define KEY_SETTING_LANGUAGE_ID         13
-#define KEY_SETTING_SHOW_LEADING_ZERO   15
-#define KEY_SETTING_SHOW_BATTERY_PCT    16
-#define KEY_SETTING_DISABLE_WEATHER     17
-#define KEY_SETTING_CLOCK_FONT_ID       18
-#define KEY_SETTING_HOURLY_VIBE         19
-#define KEY_SETTING_USE_LARGE_FONTS     21
-#define KEY_WIDGET_0_ID                 22
-#define KEY_WIDGET_1_ID                 23
-#define KEY_WIDGET_2_ID                 24
 #define KEY_FORECAST_CONDITION          25
 #define KEY_FORECAST_TEMP_HIGH          26
 #define KEY_FORECAST_TEMP_LOW           27
-#define KEY_SETTING_ALTCLOCK_NAME       28
-#define KEY_SETTING_ALTCLOCK_OFFSET     29
-#define KEY_SETTING_DECIMAL_SEPARATOR   30
-#define KEY_SETTING_HEALTH_USE_DISTANCE 31
-#define KEY_SETTING_HEALTH_USE_RESTFUL_SLEEP 32
-#define KEY_SETTING_DISABLE_AUTOBATTERY 33
+#define KEY_TELEMETRY_DUMP              34
+#define KEY_TELEMETRY_DATA              35
+#define KEY_TELEMETRY_INDEX             36
+#define KEY_TELEMETRY_COUNT             37
+#define KEY_SETTINGS                    38
+#define KEY_WEATHER_HOURLY              39
 
+// don't ask the phone for weather more often than this, in seconds
+#define WEATHER_REQUEST_MIN_INTERVAL (10 * 60)
+
+// when we last asked for weather, or 0 if we haven't yet
+extern time_t messaging_lastWeatherRequest;
+
+/*
+ * Asks the phone for new weather data. Does nothing while the phone is
+ * disconnected, or if we already asked within WEATHER_REQUEST_MIN_INTERVAL
+ */
 void messaging_requestNewWeatherData();
 
-void messaging_init(void (*message_processed_callback)(void));
+/*
+ * message_processed_callback is called with the RedrawFlags for whatever an
+ * incoming message changed, if anything
+ */
+void messaging_init(void (*message_processed_callback)(uint8_t changed));
 void inbox_received_callback(DictionaryIterator *iterator, void *context);
 void inbox_dropped_callback(AppMessageResult reason, void *context);
 void outbox_failed_callback(DictionaryIterator *iterator, AppMessageResult reason, void *context);
@@ -0,0 +1,449 @@
+#ifdef TIMESTYLE_REPLAY
+
+// this file needs the real services, not the stand-ins
+#define REPLAY_NO_WRAP
+
+#include <pebble.h>
+#include "messaging.h"
+#include "weather.h"
+#include "storage.h"
+#include "tick_scheduler.h"
+#include "util.h"
+#include "replay.h"
+
+// give the watch some time to settle before starting, and between events
+#define START_DELAY_MS 2000
+#define STEP_DELAY_MS 5
+
+// big enough for a weather message with a full hourly forecast
+#define MESSAGE_BUFFER_SIZE 128
+
+// the canned forecast sent in answer to weather requests
+#define FORECAST_INTERVAL_MINUTES 180
+
+#define AT(hours, minutes) ((hours) * 60 * 60 + (minutes) * 60)
+
+/*
+ * One scripted event. What value and flag mean depends on the type:
+ * bluetooth: flag is connected. battery: value is the charge, flag is charging.
+ * focus: flag is focused. weather: value is the temperature, and the message
+ * includes a new hourly forecast if flag is set
+ */
+typedef struct {
+  uint32_t time; // seconds after REPLAY_START_TIME
+  ReplayEventType type;
+  int8_t value;
+  bool flag;
+} ReplayEvent;
+
+// must be in time order. Ticks aren't in here, they're generated as needed
+const ReplayEvent Replay_script[] = {
+  // off the charger, with the phone nearby
+  { AT(0, 0),       REPLAY_EVENT_BLUETOOTH, 0,  true  },
+  { AT(0, 0),       REPLAY_EVENT_BATTERY,   90, false },
+  { AT(3, 0),       REPLAY_EVENT_BATTERY,   80, false },
+  { AT(6, 0),       REPLAY_EVENT_BATTERY,   70, false },
+  { AT(7, 15),      REPLAY_EVENT_FOCUS,     0,  false },
+  { AT(7, 15) + 20, REPLAY_EVENT_FOCUS,     0,  true  },
+
+  // the phone is left at home for the morning
+  { AT(8, 10),      REPLAY_EVENT_BLUETOOTH, 0,  false },
+  { AT(9, 0),       REPLAY_EVENT_BATTERY,   60, false },
+  { AT(11, 40),     REPLAY_EVENT_BLUETOOTH, 0,  true  },
+  { AT(12, 0),      REPLAY_EVENT_BATTERY,   50, false },
+  { AT(12, 30),     REPLAY_EVENT_WEATHER,   19, false },
+
+  // a flapping connection
+  { AT(13, 2),      REPLAY_EVENT_BLUETOOTH, 0,  false },
+  { AT(13, 2) + 30, REPLAY_EVENT_BLUETOOTH, 0,  true  },
+  { AT(13, 3),      REPLAY_EVENT_BLUETOOTH, 0,  false },
+  { AT(13, 3) + 10, REPLAY_EVENT_BLUETOOTH, 0,  true  },
+
+  // a few notifications
+  { AT(14, 5),      REPLAY_EVENT_FOCUS,     0,  false },
+  { AT(14, 5) + 15, REPLAY_EVENT_FOCUS,     0,  true  },
+  { AT(14, 50),     REPLAY_EVENT_FOCUS,     0,  false },
+  { AT(14, 51),     REPLAY_EVENT_FOCUS,     0,  true  },
+  { AT(15, 0),      REPLAY_EVENT_BATTERY,   40, false },
+  { AT(17, 30),     REPLAY_EVENT_WEATHER,   16, true  },
+  { AT(18, 0),      REPLAY_EVENT_BATTERY,   30, false },
+  { AT(20, 20),     REPLAY_EVENT_FOCUS,     0,  false },
+  { AT(20, 20) + 5, REPLAY_EVENT_FOCUS,     0,  true  },
+  { AT(21, 0),      REPLAY_EVENT_BATTERY,   20, false },
+
+  // the evening charge
+  { AT(22, 0),      REPLAY_EVENT_BATTERY,   20, true  },
+  { AT(22, 30),     REPLAY_EVENT_BATTERY,   60, true  },
+  { AT(23, 10),     REPLAY_EVENT_BATTERY,   90, true  },
+  { AT(23, 30),     REPLAY_EVENT_BATTERY,   100, false },
+};
+
+const char* Replay_eventNames[REPLAY_EVENT_TYPE_COUNT] = {
+  "tick", "bluetooth", "battery", "focus", "weather"
+};
+
+// the weather conditions of the canned forecast, repeated as needed
+const uint8_t Replay_forecastConditions[] = {
+  CLEAR_NIGHT, PARTLY_CLOUDY_NIGHT, PARTLY_CLOUDY, CLOUDY_DAY,
+  LIGHT_RAIN, CLOUDY_DAY, PARTLY_CLOUDY, CLEAR_NIGHT
+};
+
+ReplayHandlers Replay_handlers;
+void (*Replay_finishedCallback)(void);
+
+bool Replay_running = false;
+uint32_t Replay_startMs;
+
+// the simulated state of the world
+time_t Replay_now;
+time_t Replay_lastTick;
+TimeUnits Replay_tickUnit;
+bool Replay_bluetoothConnected;
+BatteryChargeState Replay_batteryState;
+
+int Replay_scriptIndex;
+bool Replay_weatherReplyPending;
+
+// everything is counted against the last event dispatched
+ReplayEventType Replay_currentType;
+uint32_t Replay_eventCounts[REPLAY_EVENT_TYPE_COUNT];
+uint32_t Replay_counters[REPLAY_EVENT_TYPE_COUNT][REPLAY_COUNTER_COUNT];
+
+uint8_t Replay_outboxBuffer[MESSAGE_BUFFER_SIZE];
+DictionaryIterator Replay_outbox;
+
+void Replay_timerCallback(void* context);
+void Replay_finish();
+
+void Replay_start(ReplayHandlers handlers, void (*finished_callback)(void)) {
+  Replay_handlers = handlers;
+  Replay_finishedCallback = finished_callback;
+
+  app_timer_register(START_DELAY_MS, Replay_timerCallback, NULL);
+}
+
+void Replay_freeze(time_t now, bool connected, BatteryChargeState battery) {
+  Replay_now = now;
+  Replay_bluetoothConnected = connected;
+  Replay_batteryState = battery;
+
+  TickScheduler_deinit();
+  Replay_running = true;
+}
+
+void Replay_count(ReplayCounter counter) {
+  if(Replay_running) {
+    Replay_counters[Replay_currentType][counter]++;
+  }
+}
+
+/*
+ * Sets up the simulated world and takes over the tick timer. Everything else
+ * the replay controls is only read through the stand-ins while it's running
+ */
+void startReplay() {
+  Replay_now = REPLAY_START_TIME;
+  Replay_lastTick = REPLAY_START_TIME - 1;
+  Replay_tickUnit = 0;
+  Replay_bluetoothConnected = true;
+  Replay_batteryState = (BatteryChargeState) { .charge_percent = 100 };
+
+  Replay_scriptIndex = 0;
+  Replay_weatherReplyPending = false;
+
+  Replay_currentType = REPLAY_EVENT_TICK;
+  memset(Replay_eventCounts, 0, sizeof(Replay_eventCounts));
+  memset(Replay_counters, 0, sizeof(Replay_counters));
+
+  // start without any weather, as if freshly installed
+  memset(&Weather_hourlyForecast, 0, sizeof(WeatherHourlyForecast));
+  messaging_lastWeatherRequest = 0;
+
+  // writes that were waiting belong to the real world
+  Storage_flush();
+
+  APP_LOG(APP_LOG_LEVEL_INFO, "Replay: starting, %d scripted events",
+          (int)ARRAY_LENGTH(Replay_script));
+
+  TickScheduler_deinit();
+
+  Replay_running = true;
+  Replay_startMs = time_get_ms();
+
+  // subscribes to the replay's ticks now
+  TickScheduler_init(Replay_handlers.tick);
+}
+
+uint32_t getTickInterval() {
+  return (Replay_tickUnit & SECOND_UNIT) ? 1 : 60;
+}
+
+void dispatchTick() {
+  struct tm tickTime = *localtime(&Replay_now);
+  TimeUnits unitsChanged = SECOND_UNIT;
+
+  if(tickTime.tm_sec == 0) {
+    unitsChanged |= MINUTE_UNIT;
+
+    if(tickTime.tm_min == 0) {
+      unitsChanged |= HOUR_UNIT;
+
+      if(tickTime.tm_hour == 0) {
+        unitsChanged |= DAY_UNIT;
+      }
+    }
+  }
+
+  Replay_lastTick = Replay_now;
+  Replay_handlers.tick(&tickTime, unitsChanged);
+}
+
+/*
+ * Plays the phone: sends the current conditions, and if requested an hourly
+ * forecast starting at the current hour
+ */
+void sendWeather(int temperature, uint8_t condition, bool includeForecast) {
+  uint8_t buffer[MESSAGE_BUFFER_SIZE];
+  DictionaryIterator iterator;
+
+  dict_write_begin(&iterator, buffer, sizeof(buffer));
+  dict_write_int32(&iterator, KEY_TEMPERATURE, temperature);
+  dict_write_int32(&iterator, KEY_CONDITION_CODE, condition);
+
+  if(includeForecast) {
+    uint8_t forecast[7 + WEATHER_HOURLY_POINTS * 2];
+    uint32_t startTime = Replay_now - Replay_now % (60 * 60);
+
+    forecast[0] = startTime & 0xFF;
+    forecast[1] = (startTime >> 8) & 0xFF;
+    forecast[2] = (startTime >> 16) & 0xFF;
+    forecast[3] = (startTime >> 24) & 0xFF;
+    forecast[4] = FORECAST_INTERVAL_MINUTES & 0xFF;
+    forecast[5] = FORECAST_INTERVAL_MINUTES >> 8;
+    forecast[6] = WEATHER_HOURLY_POINTS;
+
+    for(int i = 0; i < WEATHER_HOURLY_POINTS; i++) {
+      forecast[7 + i * 2] = (uint8_t)(int8_t)(temperature - 4 + (i % 4) * 2);
+      forecast[8 + i * 2] = Replay_forecastConditions[i % ARRAY_LENGTH(Replay_forecastConditions)];
+    }
+
+    dict_write_data(&iterator, KEY_WEATHER_HOURLY, forecast, sizeof(forecast));
+  }
+
+  uint32_t size = dict_write_end(&iterator);
+
+  dict_read_begin_from_buffer(&iterator, buffer, size);
+  inbox_received_callback(&iterator, NULL);
+}
+
+void dispatchScriptEvent(const ReplayEvent* event) {
+  switch(event->type) {
+    case REPLAY_EVENT_BLUETOOTH:
+      Replay_bluetoothConnected = event->flag;
+      Replay_handlers.bluetooth(event->flag);
+      break;
+    case REPLAY_EVENT_BATTERY:
+      Replay_batteryState = (BatteryChargeState) {
+        .charge_percent = event->value,
+        .is_charging = event->flag,
+        .is_plugged = event->flag
+      };
+      Replay_handlers.battery(Replay_batteryState);
+      break;
+    case REPLAY_EVENT_FOCUS:
+      Replay_handlers.focus.will_focus(event->flag);
+      Replay_handlers.focus.did_focus(event->flag);
+      break;
+    case REPLAY_EVENT_WEATHER:
+      sendWeather(event->value, CLOUDY_DAY, event->flag);
+      break;
+    default:
+      break;
+  }
+}
+
+void Replay_timerCallback(void* context) {
+  if(!Replay_running) {
+    startReplay();
+  } else if(Replay_weatherReplyPending) {
+    // answer the request sent by the last event straight away
+    Replay_weatherReplyPending = false;
+    Replay_currentType = REPLAY_EVENT_WEATHER;
+    Replay_eventCounts[REPLAY_EVENT_WEATHER]++;
+
+    sendWeather(18, PARTLY_CLOUDY, true);
+  } else {
+    // whichever comes first: the next scripted event or the next tick
+    time_t endTime = REPLAY_START_TIME + REPLAY_DURATION;
+    time_t nextTick = endTime;
+    time_t nextEvent = endTime;
+
+    if(Replay_tickUnit) {
+      uint32_t interval = getTickInterval();
+      nextTick = (Replay_lastTick / interval + 1) * interval;
+    }
+
+    if(Replay_scriptIndex < (int)ARRAY_LENGTH(Replay_script)) {
+      nextEvent = REPLAY_START_TIME + Replay_script[Replay_scriptIndex].time;
+    }
+
+    time_t nextTime = (nextEvent <= nextTick) ? nextEvent : nextTick;
+
+    if(nextTime >= endTime) {
+      Replay_finish();
+      return;
+    }
+
+    // on the watch, any storage writes would have gone out by now
+    if(nextTime - Replay_now >= STORAGE_WRITE_DELAY_MS / 1000) {
+      Storage_flush();
+    }
+
+    Replay_now = nextTime;
+
+    if(nextEvent <= nextTick) {
+      const ReplayEvent* event = &Replay_script[Replay_scriptIndex++];
+
+      Replay_currentType = event->type;
+      Replay_eventCounts[event->type]++;
+
+      dispatchScriptEvent(event);
+    } else {
+      Replay_currentType = REPLAY_EVENT_TICK;
+      Replay_eventCounts[REPLAY_EVENT_TICK]++;
+
+      dispatchTick();
+    }
+  }
+
+  // the next event runs after this one has been drawn
+  app_timer_register(STEP_DELAY_MS, Replay_timerCallback, NULL);
+}
+
+void Replay_finish() {
+  Storage_flush();
+
+  uint32_t totals[REPLAY_COUNTER_COUNT] = { 0 };
+
+  APP_LOG(APP_LOG_LEVEL_INFO, "Replay: event, count, redraws, resource loads, persist writes, messages sent");
+
+  for(int i = 0; i < REPLAY_EVENT_TYPE_COUNT; i++) {
+    uint32_t* counters = Replay_counters[i];
+
+    APP_LOG(APP_LOG_LEVEL_INFO, "Replay: %s, %d, %d, %d, %d, %d", Replay_eventNames[i],
+            (int)Replay_eventCounts[i],
+            (int)counters[REPLAY_COUNTER_REDRAWS],
+            (int)counters[REPLAY_COUNTER_RESOURCE_LOADS],
+            (int)counters[REPLAY_COUNTER_PERSIST_WRITES],
+            (int)counters[REPLAY_COUNTER_MESSAGES_SENT]);
+
+    for(int j = 0; j < REPLAY_COUNTER_COUNT; j++) {
+      totals[j] += counters[j];
+    }
+  }
+
+  APP_LOG(APP_LOG_LEVEL_INFO, "Replay: total, -, %d, %d, %d, %d",
+          (int)totals[REPLAY_COUNTER_REDRAWS],
+          (int)totals[REPLAY_COUNTER_RESOURCE_LOADS],
+          (int)totals[REPLAY_COUNTER_PERSIST_WRITES],
+          (int)totals[REPLAY_COUNTER_MESSAGES_SENT]);
+
+  APP_LOG(APP_LOG_LEVEL_INFO, "Replay: done in %d ms", (int)(time_get_ms() - Replay_startMs));
+
+  // back to the real world
+  TickScheduler_deinit();
+  Replay_running = false;
+  TickScheduler_init(Replay_handlers.tick);
+
+  Replay_handlers.bluetooth(bluetooth_connection_service_peek());
+  Replay_handlers.battery(battery_state_service_peek());
+
+  Replay_finishedCallback();
+}
+
+time_t Replay_time(time_t* t) {
+  if(!Replay_running) {
+    return time(t);
+  }
+
+  if(t) {
+    *t = Replay_now;
+  }
+
+  return Replay_now;
+}
+
+bool Replay_bluetoothPeek() {
+  return Replay_running ? Replay_bluetoothConnected : bluetooth_connection_service_peek();
+}
+
+BatteryChargeState Replay_batteryPeek() {
+  return Replay_running ? Replay_batteryState : battery_state_service_peek();
+}
+
+void Replay_tickSubscribe(TimeUnits units, TickHandler handler) {
+  if(Replay_running) {
+    Replay_tickUnit = units;
+  } else {
+    tick_timer_service_subscribe(units, handler);
+  }
+}
+
+void Replay_tickUnsubscribe() {
+  if(Replay_running) {
+    Replay_tickUnit = 0;
+  } else {
+    tick_timer_service_unsubscribe();
+  }
+}
+
+AppMessageResult Replay_outboxBegin(DictionaryIterator** iterator) {
+  if(!Replay_running) {
+    return app_message_outbox_begin(iterator);
+  }
+
+  dict_write_begin(&Replay_outbox, Replay_outboxBuffer, sizeof(Replay_outboxBuffer));
+  *iterator = &Replay_outbox;
+
+  return APP_MSG_OK;
+}
+
+AppMessageResult Replay_outboxSend() {
+  if(!Replay_running) {
+    return app_message_outbox_send();
+  }
+
+  Replay_count(REPLAY_COUNTER_MESSAGES_SENT);
+
+  uint32_t size = dict_write_end(&Replay_outbox);
+  dict_read_begin_from_buffer(&Replay_outbox, Replay_outboxBuffer, size);
+
+  // an empty weather request, which the phone answers if it's there
+  if(dict_find(&Replay_outbox, 0) != NULL && Replay_bluetoothConnected) {
+    Replay_weatherReplyPending = true;
+  }
+
+  return APP_MSG_OK;
+}
+
+status_t Replay_persistWriteInt(uint32_t key, int32_t value) {
+  if(!Replay_running) {
+    return persist_write_int(key, value);
+  }
+
+  Replay_count(REPLAY_COUNTER_PERSIST_WRITES);
+
+  return S_SUCCESS;
+}
+
+int Replay_persistWriteData(uint32_t key, const void* data, size_t size) {
+  if(!Replay_running) {
+    return persist_write_data(key, data, size);
+  }
+
+  Replay_count(REPLAY_COUNTER_PERSIST_WRITES);
+
+  return size;
+}
+
+#endif
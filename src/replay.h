@@ -0,0 +1,99 @@
+#pragma once
+#include <pebble.h>
+
+/*
+ * Scripted event replay, only compiled in when building with TIMESTYLE_REPLAY=1
+ * in the environment (see wscript). Like the benchmark, it runs on the watch
+ * or the emulator so that the real services and graphics stack are used.
+ *
+ * A simulated day starting at REPLAY_START_TIME is fed to the watchface's own
+ * handlers as fast as it can draw: ticks at whatever rate the tick scheduler
+ * asks for, plus the Bluetooth drops, charge cycle, notifications and weather
+ * pushes in the script (see replay.c). The phone is simulated too: weather
+ * requests are answered with a canned forecast and nothing is actually sent.
+ *
+ * Everything the watchface does between one event and the next is counted
+ * against that event's type: sidebar redraws, resource loads, persistent
+ * storage writes and outbound messages. The totals per event type are written
+ * to the app log at the end, then the watchface goes back to the real time.
+ *
+ * The counts only depend on the settings and the watch's time zone. Health
+ * data is still read live, and storage writes are counted but not made, so
+ * restart the watchface afterwards to get the real weather data back.
+ */
+#ifdef TIMESTYLE_REPLAY
+
+// 2016-10-01 00:00:00 UTC
+#define REPLAY_START_TIME 1475280000
+#define REPLAY_DURATION (24 * 60 * 60)
+
+typedef enum {
+  REPLAY_EVENT_TICK,
+  REPLAY_EVENT_BLUETOOTH,
+  REPLAY_EVENT_BATTERY,
+  REPLAY_EVENT_FOCUS,
+  REPLAY_EVENT_WEATHER,
+  REPLAY_EVENT_TYPE_COUNT
+} ReplayEventType;
+
+typedef enum {
+  REPLAY_COUNTER_REDRAWS,
+  REPLAY_COUNTER_RESOURCE_LOADS,
+  REPLAY_COUNTER_PERSIST_WRITES,
+  REPLAY_COUNTER_MESSAGES_SENT,
+  REPLAY_COUNTER_COUNT
+} ReplayCounter;
+
+/*
+ * The watchface's event handlers, which the replay calls in place of the
+ * services they're normally subscribed to
+ */
+typedef struct {
+  TickHandler tick;
+  BluetoothConnectionHandler bluetooth;
+  BatteryStateHandler battery;
+  AppFocusHandlers focus;
+} ReplayHandlers;
+
+/*
+ * Starts the replay after a short delay. finished_callback is called once the
+ * simulated day is over and the real services are back
+ */
+void Replay_start(ReplayHandlers handlers, void (*finished_callback)(void));
+
+/*
+ * Makes the stand-ins answer from a fixed world instead of playing the script,
+ * for builds that need the watchface to hold still. There are no more ticks
+ * after this, and it stays frozen until the watchface exits
+ */
+void Replay_freeze(time_t now, bool connected, BatteryChargeState battery);
+
+/*
+ * Counts something against the current event, if a replay is running
+ */
+void Replay_count(ReplayCounter counter);
+
+// stand-ins for the services that the replay simulates
+time_t Replay_time(time_t* t);
+bool Replay_bluetoothPeek();
+BatteryChargeState Replay_batteryPeek();
+void Replay_tickSubscribe(TimeUnits units, TickHandler handler);
+void Replay_tickUnsubscribe();
+AppMessageResult Replay_outboxBegin(DictionaryIterator** iterator);
+AppMessageResult Replay_outboxSend();
+status_t Replay_persistWriteInt(uint32_t key, int32_t value);
+int Replay_persistWriteData(uint32_t key, const void* data, size_t size);
+
+#ifndef REPLAY_NO_WRAP
+  #define time(...)                           Replay_time(__VA_ARGS__)
+  #define bluetooth_connection_service_peek() Replay_bluetoothPeek()
+  #define battery_state_service_peek()        Replay_batteryPeek()
+  #define tick_timer_service_subscribe(...)   Replay_tickSubscribe(__VA_ARGS__)
+  #define tick_timer_service_unsubscribe()    Replay_tickUnsubscribe()
+  #define app_message_outbox_begin(...)       Replay_outboxBegin(__VA_ARGS__)
+  #define app_message_outbox_send()           Replay_outboxSend()
+  #define persist_write_int(...)              Replay_persistWriteInt(__VA_ARGS__)
+  #define persist_write_data(...)             Replay_persistWriteData(__VA_ARGS__)
+#endif
+
+#endif
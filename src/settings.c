@@ -1,5 +1,8 @@
 #include <pebble.h>
 #include "settings.h"
+#include "weather.h"
+#include "util.h"
+#include "storage.h"
 
 Settings globalSettings;
 
@@ -130,6 +133,8 @@ void Settings_saveToStorage() {
   StoredSettings storedSettings;
   // if previous version settings are used than only first part of settings would be overwrited
   // all the other fields will left filled with zeroes
+  // (this also keeps the padding bits stable, so unchanged settings compare equal)
+  memset(&storedSettings, 0, sizeof(StoredSettings));
   storedSettings.timeColor = globalSettings.timeColor;
   storedSettings.timeBgColor = globalSettings.timeBgColor;
   storedSettings.sidebarColor = globalSettings.sidebarColor;
@@ -153,16 +158,16 @@ void Settings_saveToStorage() {
   memcpy(storedSettings.altclockName, globalSettings.altclockName, 8);
   storedSettings.altclockOffset = globalSettings.altclockOffset;
 
-  persist_write_data(SETTING_VERSION6_AND_HIGHER, &storedSettings, sizeof(StoredSettings));
-  persist_write_int(SETTINGS_VERSION_KEY, CURRENT_SETTINGS_VERSION);
+  // only written if something changed
+  Storage_writeData(SETTING_VERSION6_AND_HIGHER, &storedSettings, sizeof(StoredSettings));
+  Storage_writeInt(SETTINGS_VERSION_KEY, CURRENT_SETTINGS_VERSION);
 }
 
 void Settings_updateDynamicSettings() {
   globalSettings.disableWeather = true;
-  globalSettings.updateScreenEverySecond = false;
   globalSettings.enableAutoBatteryWidget = true;
 
-  for(int i = 0; i < 3; i++) {
+  for(int i = 0; i < SIDEBAR_WIDGET_SLOTS; i++) {
     // if there are any weather widgets, enable weather checking
     // if(globalSettings.widgets[i] == WEATHER_CURRENT ||
     //    globalSettings.widgets[i] == WEATHER_FORECAST_TODAY) {
@@ -170,11 +175,6 @@ void Settings_updateDynamicSettings() {
       globalSettings.disableWeather = false;
     }
 
-    // if any widget is "seconds", we'll need to update the sidebar every second
-    if(globalSettings.widgets[i] == SECONDS) {
-      globalSettings.updateScreenEverySecond = true;
-    }
-
     // if any widget is "battery", disable the automatic battery indication
     if(globalSettings.widgets[i] == BATTERY_METER) {
       globalSettings.enableAutoBatteryWidget = false;
@@ -189,4 +189,130 @@ void Settings_updateDynamicSettings() {
     globalSettings.iconFillColor = GColorWhite;
     globalSettings.iconStrokeColor = GColorBlack;
   }
+
+  // retint the icons now, rather than every time they're drawn
+  SidebarWidgets_updateIconColors();
+  Weather_updateIconColors();
+}
+
+// what needs redoing when each field changes, indexed by SettingsBlobField
+const uint8_t Settings_fieldRedrawFlags[SETTINGS_FIELD_ALTCLOCK_OFFSET + 1] = {
+  [SETTINGS_FIELD_TIME_COLOR]               = REDRAW_COLORS,
+  [SETTINGS_FIELD_TIME_BG_COLOR]            = REDRAW_COLORS,
+  [SETTINGS_FIELD_SIDEBAR_COLOR]            = REDRAW_COLORS,
+  [SETTINGS_FIELD_SIDEBAR_TEXT_COLOR]       = REDRAW_COLORS,
+  [SETTINGS_FIELD_LANGUAGE_ID]              = REDRAW_LANGUAGE,
+  [SETTINGS_FIELD_SHOW_LEADING_ZERO]        = REDRAW_FONT | REDRAW_LAYOUT,
+  [SETTINGS_FIELD_CLOCK_FONT_ID]            = REDRAW_FONT,
+  [SETTINGS_FIELD_WIDGET_0]                 = REDRAW_LAYOUT | REDRAW_TICK_RATE,
+  [SETTINGS_FIELD_WIDGET_1]                 = REDRAW_LAYOUT | REDRAW_TICK_RATE,
+  [SETTINGS_FIELD_WIDGET_2]                 = REDRAW_LAYOUT | REDRAW_TICK_RATE,
+  [SETTINGS_FIELD_SIDEBAR_LEFT]             = REDRAW_LAYOUT,
+  [SETTINGS_FIELD_USE_LARGE_FONTS]          = REDRAW_LAYOUT,
+  [SETTINGS_FIELD_USE_METRIC]               = REDRAW_WEATHER,
+  [SETTINGS_FIELD_SHOW_BATTERY_PCT]         = REDRAW_LAYOUT,
+  [SETTINGS_FIELD_DISABLE_AUTOBATTERY]      = REDRAW_LAYOUT | REDRAW_TICK_RATE,
+  [SETTINGS_FIELD_HEALTH_USE_DISTANCE]      = REDRAW_LAYOUT,
+  [SETTINGS_FIELD_HEALTH_USE_RESTFUL_SLEEP] = REDRAW_LAYOUT,
+  [SETTINGS_FIELD_DECIMAL_SEPARATOR]        = REDRAW_LAYOUT,
+  [SETTINGS_FIELD_ALTCLOCK_NAME]            = REDRAW_LAYOUT,
+  [SETTINGS_FIELD_ALTCLOCK_OFFSET]          = REDRAW_LAYOUT
+};
+
+bool Settings_applyBlob(const uint8_t* data, uint16_t length, uint8_t* changed) {
+  if(length < 1 || data[0] != SETTINGS_BLOB_VERSION) {
+    LOG(APP_LOG_LEVEL_WARNING, "Unsupported settings blob version");
+    return false;
+  }
+
+  uint16_t i = 1;
+
+  // every field has at least an ID and one byte of value
+  while(i + 1 < length) {
+    uint8_t field = data[i++];
+    uint8_t value = data[i++];
+
+    switch(field) {
+      case SETTINGS_FIELD_TIME_COLOR:
+        globalSettings.timeColor = (GColor){ .argb = value };
+        break;
+      case SETTINGS_FIELD_TIME_BG_COLOR:
+        globalSettings.timeBgColor = (GColor){ .argb = value };
+        break;
+      case SETTINGS_FIELD_SIDEBAR_COLOR:
+        globalSettings.sidebarColor = (GColor){ .argb = value };
+        break;
+      case SETTINGS_FIELD_SIDEBAR_TEXT_COLOR:
+        globalSettings.sidebarTextColor = (GColor){ .argb = value };
+        break;
+      case SETTINGS_FIELD_LANGUAGE_ID:
+        globalSettings.languageId = value;
+        break;
+      case SETTINGS_FIELD_SHOW_LEADING_ZERO:
+        globalSettings.showLeadingZero = (bool)value;
+        break;
+      case SETTINGS_FIELD_CLOCK_FONT_ID:
+        globalSettings.clockFontId = value;
+        break;
+      case SETTINGS_FIELD_BT_VIBE:
+        globalSettings.btVibe = (bool)value;
+        break;
+      case SETTINGS_FIELD_HOURLY_VIBE:
+        globalSettings.hourlyVibe = value;
+        break;
+      case SETTINGS_FIELD_WIDGET_0:
+      case SETTINGS_FIELD_WIDGET_1:
+      case SETTINGS_FIELD_WIDGET_2:
+        globalSettings.widgets[field - SETTINGS_FIELD_WIDGET_0] = value;
+        break;
+      case SETTINGS_FIELD_SIDEBAR_LEFT:
+        globalSettings.sidebarOnLeft = (bool)value;
+        break;
+      case SETTINGS_FIELD_USE_LARGE_FONTS:
+        globalSettings.useLargeFonts = (bool)value;
+        break;
+      case SETTINGS_FIELD_USE_METRIC:
+        globalSettings.useMetric = (bool)value;
+        break;
+      case SETTINGS_FIELD_SHOW_BATTERY_PCT:
+        globalSettings.showBatteryPct = (bool)value;
+        break;
+      case SETTINGS_FIELD_DISABLE_AUTOBATTERY:
+        globalSettings.disableAutobattery = (bool)value;
+        break;
+      case SETTINGS_FIELD_HEALTH_USE_DISTANCE:
+        globalSettings.healthUseDistance = (bool)value;
+        break;
+      case SETTINGS_FIELD_HEALTH_USE_RESTFUL_SLEEP:
+        globalSettings.healthUseRestfulSleep = (bool)value;
+        break;
+      case SETTINGS_FIELD_DECIMAL_SEPARATOR:
+        globalSettings.decimalSeparator = (char)value;
+        break;
+      case SETTINGS_FIELD_ALTCLOCK_NAME: {
+        // here the value is the length of the name that follows
+        if(i + value > length) {
+          return false;
+        }
+
+        uint8_t nameLength = (value < sizeof(globalSettings.altclockName)) ? value : sizeof(globalSettings.altclockName) - 1;
+        memcpy(globalSettings.altclockName, &data[i], nameLength);
+        globalSettings.altclockName[nameLength] = '\0';
+
+        i += value;
+        break;
+      }
+      case SETTINGS_FIELD_ALTCLOCK_OFFSET:
+        globalSettings.altclockOffset = (int8_t)value;
+        break;
+      default:
+        // we can't tell how long an unknown field is, so stop here
+        LOG(APP_LOG_LEVEL_WARNING, "Unknown settings field %d", field);
+        return false;
+    }
+
+    *changed |= Settings_fieldRedrawFlags[field];
+  }
+
+  return true;
 }
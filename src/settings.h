@@ -4,6 +4,9 @@
 
 #define SETTINGS_VERSION_KEY 4
 
+// the number of configurable sidebar widgets
+#define SIDEBAR_WIDGET_SLOTS 3
+
 // settings "version" for app version 4.0
 #define CURRENT_SETTINGS_VERSION 6
 
@@ -24,7 +27,7 @@ typedef struct {
   int hourlyVibe;
 
   // sidebar settings
-  SidebarWidgetType widgets[3];
+  SidebarWidgetType widgets[SIDEBAR_WIDGET_SLOTS];
   bool sidebarOnLeft;
   bool useLargeFonts;
 
@@ -46,7 +49,6 @@ typedef struct {
 
   // dynamic settings (calculated based the currently-selected widgets)
   bool disableWeather;
-  bool updateScreenEverySecond;
   bool enableAutoBatteryWidget;
 
   // TODO: these shouldn't be dynamic
@@ -96,6 +98,39 @@ typedef struct {
 
 extern Settings globalSettings;
 
+/*
+ * The settings blob sent by the phone. It starts with the version byte,
+ * followed by one [field][value] pair per changed setting. Colors are sent
+ * as GColor8 bytes, and the alt clock name as [field][length][characters].
+ * app.js has the matching encoder.
+ */
+#define SETTINGS_BLOB_VERSION 1
+
+typedef enum {
+  SETTINGS_FIELD_TIME_COLOR               = 1,
+  SETTINGS_FIELD_TIME_BG_COLOR            = 2,
+  SETTINGS_FIELD_SIDEBAR_COLOR            = 3,
+  SETTINGS_FIELD_SIDEBAR_TEXT_COLOR       = 4,
+  SETTINGS_FIELD_LANGUAGE_ID              = 5,
+  SETTINGS_FIELD_SHOW_LEADING_ZERO        = 6,
+  SETTINGS_FIELD_CLOCK_FONT_ID            = 7,
+  SETTINGS_FIELD_BT_VIBE                  = 8,
+  SETTINGS_FIELD_HOURLY_VIBE              = 9,
+  SETTINGS_FIELD_WIDGET_0                 = 10,
+  SETTINGS_FIELD_WIDGET_1                 = 11,
+  SETTINGS_FIELD_WIDGET_2                 = 12,
+  SETTINGS_FIELD_SIDEBAR_LEFT             = 13,
+  SETTINGS_FIELD_USE_LARGE_FONTS          = 14,
+  SETTINGS_FIELD_USE_METRIC               = 15,
+  SETTINGS_FIELD_SHOW_BATTERY_PCT         = 16,
+  SETTINGS_FIELD_DISABLE_AUTOBATTERY      = 17,
+  SETTINGS_FIELD_HEALTH_USE_DISTANCE      = 18,
+  SETTINGS_FIELD_HEALTH_USE_RESTFUL_SLEEP = 19,
+  SETTINGS_FIELD_DECIMAL_SEPARATOR        = 20,
+  SETTINGS_FIELD_ALTCLOCK_NAME            = 21,
+  SETTINGS_FIELD_ALTCLOCK_OFFSET          = 22
+} SettingsBlobField;
+
 // persistent storage keys for each setting
 
 // color settings
@@ -146,3 +181,26 @@ void Settings_deinit();
 void Settings_loadFromStorage();
 void Settings_saveToStorage();
 void Settings_updateDynamicSettings();
+
+/*
+ * The parts of the screen that a change affects, so that only their work is
+ * redone. Settings changes and incoming weather are described with these
+ */
+typedef enum {
+  REDRAW_COLORS    = 1 << 0,  // clock, background and sidebar colors
+  REDRAW_LAYOUT    = 1 << 1,  // sidebar side, widgets and what they show
+  REDRAW_FONT      = 1 << 2,  // clock digit images
+  REDRAW_LANGUAGE  = 1 << 3,
+  REDRAW_TICK_RATE = 1 << 4,  // anything that might need ticks every second
+  REDRAW_WEATHER   = 1 << 5
+} RedrawFlags;
+
+#define REDRAW_ALL (REDRAW_COLORS | REDRAW_LAYOUT | REDRAW_FONT | REDRAW_LANGUAGE | \
+                    REDRAW_TICK_RATE | REDRAW_WEATHER)
+
+/*
+ * Applies a settings blob received from the phone, in a single pass, adding
+ * the RedrawFlags for the fields that were in it to changed. Returns false if
+ * the blob was unusable; fields decoded before a problem was found are kept.
+ */
+bool Settings_applyBlob(const uint8_t* data, uint16_t length, uint8_t* changed);
@@ -1,16 +1,62 @@
 #include <pebble.h>
 #include <ctype.h>
-#include <math.h>
 #include "settings.h"
 #include "weather.h"
 #include "languages.h"
 #include "sidebar.h"
 #include "sidebar_widgets/sidebar_widgets.h"
+#include "telemetry.h"
+#include "benchmark.h"
+#include "replay.h"
 
 #define V_PADDING 8
-#define SCREEN_HEIGHT 168
+
+#ifdef PBL_ROUND
+  #define SIDEBAR_WIDTH 40
+  #define SIDEBAR_LAYER_COUNT 2
+#else
+  #define SIDEBAR_WIDTH 30
+  #define SIDEBAR_LAYER_COUNT 1
+#endif
+
+// widgets closer together than this switch on compact mode
+#define MIN_WIDGET_GAP 5
+
+// the inputs that can change which widgets are shown, or how tall they are
+#define LAYOUT_INPUTS (WIDGET_INPUT_BLUETOOTH | WIDGET_INPUT_BATTERY | WIDGET_INPUT_HEALTH)
+
+/*
+ * Where the widgets can go on this platform: which of the configured widgets
+ * are shown, which layer each one is drawn in, and the vertical space each
+ * layer has for widgets. Widgets sharing a layer are spread out from its top
+ * to its bottom; a widget on its own is centered
+ */
+typedef struct {
+  uint8_t slotCount;
+  uint8_t slots[SIDEBAR_WIDGET_SLOTS];      // indices into globalSettings.widgets
+  uint8_t slotLayers[SIDEBAR_WIDGET_SLOTS];
+  uint8_t replaceableSlot;                  // taken by the auto battery or disconnect icon if nothing better is free
+  int16_t layerTop[SIDEBAR_LAYER_COUNT];
+  int16_t layerBottom[SIDEBAR_LAYER_COUNT];
+  int8_t layerXOffset[SIDEBAR_LAYER_COUNT];
+} SidebarGeometry;
+
+/*
+ * Where each widget goes. This only changes with the settings or with the
+ * LAYOUT_INPUTS, so it's worked out once and reused by every redraw
+ */
+typedef struct {
+  bool valid;
+  bool compactMode;
+  SidebarWidgetType widgets[SIDEBAR_WIDGET_SLOTS];
+  int16_t positions[SIDEBAR_WIDGET_SLOTS];
+} SidebarLayout;
 
 // "private" functions
+void getDisplayedWidgets(SidebarWidgetType displayWidgets[SIDEBAR_WIDGET_SLOTS]);
+void updateLayout();
+void drawSidebarWidgets(GContext* ctx, int layerIndex);
+
 // layer update callbacks
 void updateRectSidebar(Layer *l, GContext* ctx);
 
@@ -19,32 +65,81 @@ void updateRectSidebar(Layer *l, GContext* ctx);
   void updateRoundSidebarRight(Layer *l, GContext* ctx);
 
   // shared drawing stuff between all layers
-  void drawRoundSidebar(GContext* ctx, GRect bgBounds, SidebarWidgetType widgetType, int widgetXOffset);
+  void drawRoundSidebar(GContext* ctx, GRect bgBounds, int layerIndex);
 #endif
 
 Layer* sidebarLayer;
+GRect screenBounds;
+SidebarGeometry sidebarGeometry;
+SidebarLayout sidebarLayout;
+
+// while paused, invalidations are collected here instead of redrawing
+bool sidebarPaused = false;
+uint8_t sidebarPausedInputs = 0;
 
 #ifdef PBL_ROUND
   Layer* sidebarLayer2;
 #endif
 
+/*
+ * Works out where widgets can go, from the size of the screen
+ */
+void initGeometry() {
+  SidebarGeometry* geometry = &sidebarGeometry;
+  int height = screenBounds.size.h;
+
+  #ifdef PBL_ROUND
+    // one widget in each half circle: the first and last configured ones
+    geometry->slotCount = 2;
+    geometry->slots[0] = 0;
+    geometry->slots[1] = SIDEBAR_WIDGET_SLOTS - 1;
+    geometry->slotLayers[0] = 0;
+    geometry->slotLayers[1] = 1;
+    geometry->replaceableSlot = 0;
+
+    for(int i = 0; i < SIDEBAR_LAYER_COUNT; i++) {
+      geometry->layerTop[i] = 0;
+      geometry->layerBottom[i] = height;
+    }
+
+    geometry->layerXOffset[0] = 7;
+    geometry->layerXOffset[1] = 3;
+  #else
+    // all of them, top to bottom
+    geometry->slotCount = SIDEBAR_WIDGET_SLOTS;
+
+    for(int i = 0; i < SIDEBAR_WIDGET_SLOTS; i++) {
+      geometry->slots[i] = i;
+      geometry->slotLayers[i] = 0;
+    }
+
+    geometry->replaceableSlot = SIDEBAR_WIDGET_SLOTS / 2;
+    geometry->layerTop[0] = V_PADDING;
+    geometry->layerBottom[0] = height - V_PADDING;
+    geometry->layerXOffset[0] = 0;
+  #endif
+}
+
 void Sidebar_init(Window* window) {
   // init the sidebar layer
-  GRect screenRect = layer_get_bounds(window_get_root_layer(window));
+  screenBounds = layer_get_bounds(window_get_root_layer(window));
   GRect bounds;
 
   #ifdef PBL_ROUND
     GRect bounds2;
-    bounds = GRect(0, 0, 40, screenRect.size.h);
-    bounds2 = GRect(screenRect.size.w - 40, 0, 40, screenRect.size.h);
+    bounds = GRect(0, 0, SIDEBAR_WIDTH, screenBounds.size.h);
+    bounds2 = GRect(screenBounds.size.w - SIDEBAR_WIDTH, 0, SIDEBAR_WIDTH, screenBounds.size.h);
   #else
     if(!globalSettings.sidebarOnLeft) {
-      bounds = GRect(114, 0, 30, screenRect.size.h);
+      bounds = GRect(screenBounds.size.w - SIDEBAR_WIDTH, 0, SIDEBAR_WIDTH, screenBounds.size.h);
     } else {
-      bounds = GRect(0, 0, 30, screenRect.size.h);
+      bounds = GRect(0, 0, SIDEBAR_WIDTH, screenBounds.size.h);
     }
   #endif
 
+  initGeometry();
+  sidebarLayout.valid = false;
+
   // init the widgets
   SidebarWidgets_init();
 
@@ -71,12 +166,15 @@ void Sidebar_deinit() {
 }
 
 void Sidebar_redraw() {
+  // the settings might have changed, so everything has to be laid out again
+  sidebarLayout.valid = false;
+
   #ifndef PBL_ROUND
     // reposition the sidebar if needed
     if(globalSettings.sidebarOnLeft) {
-      layer_set_frame(sidebarLayer, GRect(0, 0, 30, SCREEN_HEIGHT));
+      layer_set_frame(sidebarLayer, GRect(0, 0, SIDEBAR_WIDTH, screenBounds.size.h));
     } else {
-      layer_set_frame(sidebarLayer, GRect(114, 0, 30, SCREEN_HEIGHT));
+      layer_set_frame(sidebarLayer, GRect(screenBounds.size.w - SIDEBAR_WIDTH, 0, SIDEBAR_WIDTH, screenBounds.size.h));
     }
   #endif
 
@@ -91,8 +189,63 @@ void Sidebar_redraw() {
 void Sidebar_updateTime(struct tm* timeInfo) {
   SidebarWidgets_updateTime(timeInfo);
 
-  // redraw the sidebar in case it changed in any way
-  Sidebar_redraw();
+  // figure out which time-based inputs changed since the last update
+  static int lastSecond = -1;
+  static int lastMinute = -1;
+  static int lastDay = -1;
+
+  uint8_t changedInputs = WIDGET_INPUT_NONE;
+
+  if(timeInfo->tm_sec != lastSecond) {
+    changedInputs |= WIDGET_INPUT_SECONDS;
+  }
+
+  if(timeInfo->tm_min != lastMinute) {
+    // health data is refreshed once per minute too
+    changedInputs |= WIDGET_INPUT_MINUTE | WIDGET_INPUT_HEALTH;
+  }
+
+  if(timeInfo->tm_mday != lastDay) {
+    changedInputs |= WIDGET_INPUT_DAY;
+  }
+
+  lastSecond = timeInfo->tm_sec;
+  lastMinute = timeInfo->tm_min;
+  lastDay = timeInfo->tm_mday;
+
+  Sidebar_invalidate(changedInputs);
+}
+
+void Sidebar_invalidate(uint8_t changedInputs) {
+  if(sidebarPaused) {
+    sidebarPausedInputs |= changedInputs;
+    return;
+  }
+
+  if(changedInputs & LAYOUT_INPUTS) {
+    sidebarLayout.valid = false;
+  }
+
+  // only redraw if something that's on screen actually changed
+  if(changedInputs & Sidebar_getVisibleInputs()) {
+    layer_mark_dirty(sidebarLayer);
+
+    #ifdef PBL_ROUND
+      layer_mark_dirty(sidebarLayer2);
+    #endif
+  }
+}
+
+void Sidebar_setPaused(bool paused) {
+  sidebarPaused = paused;
+
+  // catch up on everything that changed in the meantime, all at once
+  if(!paused && sidebarPausedInputs) {
+    uint8_t changedInputs = sidebarPausedInputs;
+    sidebarPausedInputs = 0;
+
+    Sidebar_invalidate(changedInputs);
+  }
 }
 
 bool isAutoBatteryShown() {
@@ -109,53 +262,186 @@ bool isAutoBatteryShown() {
   return false;
 }
 
-
-#ifdef PBL_ROUND
+bool isWeatherWidget(SidebarWidgetType type) {
+  return type == WEATHER_CURRENT || type == WEATHER_FORECAST_TODAY;
+}
 
 // returns the best candidate widget for replacement by the auto battery
 // or the disconnection icon
 int getReplacableWidget() {
-  if(globalSettings.widgets[0] == EMPTY) {
-    return 0;
-  } else if(globalSettings.widgets[2] == EMPTY) {
-    return 2;
+  SidebarGeometry* geometry = &sidebarGeometry;
+
+  // if any widgets are empty, it's an obvious choice
+  for(int i = 0; i < geometry->slotCount; i++) {
+    if(globalSettings.widgets[geometry->slots[i]] == EMPTY) {
+      return geometry->slots[i];
+    }
   }
 
-  if(globalSettings.widgets[0] == WEATHER_CURRENT || globalSettings.widgets[0] == WEATHER_FORECAST_TODAY) {
-    return 0;
-  } else if(globalSettings.widgets[2] == WEATHER_CURRENT || globalSettings.widgets[2] == WEATHER_FORECAST_TODAY) {
-    return 2;
+  // are there any bluetooth-enabled widgets? if so, they're the second-best
+  // candidates
+  for(int i = 0; i < geometry->slotCount; i++) {
+    if(isWeatherWidget(globalSettings.widgets[geometry->slots[i]])) {
+      return geometry->slots[i];
+    }
   }
 
-  // if we don't have any of those things, just replace the left widget
-  return 0;
+  // if we don't have any of those things, just replace the default one
+  return geometry->replaceableSlot;
 }
 
-#else
+/*
+ * Determines which widgets are actually shown, taking into account any
+ * replacement by the auto battery or the disconnection icon
+ */
+void getDisplayedWidgets(SidebarWidgetType displayWidgets[SIDEBAR_WIDGET_SLOTS]) {
+  for(int i = 0; i < SIDEBAR_WIDGET_SLOTS; i++) {
+    displayWidgets[i] = globalSettings.widgets[i];
+  }
 
-// returns the best candidate widget for replacement by the auto battery
-// or the disconnection icon
-int getReplacableWidget() {
-  // if any widgets are empty, it's an obvious choice
-  for(int i = 0; i < 3; i++) {
-    if(globalSettings.widgets[i] == EMPTY) {
-      return i;
+  // if the pebble is disconnected, show the disconnect icon
+  bool showDisconnectIcon = !bluetooth_connection_service_peek();
+  bool showAutoBattery = isAutoBatteryShown();
+
+  // do we need to replace a widget?
+  // if so, determine which widget should be replaced
+  if(showAutoBattery || showDisconnectIcon) {
+    int widget_to_replace = getReplacableWidget();
+
+    if(showAutoBattery) {
+      displayWidgets[widget_to_replace] = BATTERY_METER;
+    } else if(showDisconnectIcon) {
+      displayWidgets[widget_to_replace] = BLUETOOTH_DISCONNECT;
     }
   }
+}
 
-  // are there any bluetooth-enabled widgets? if so, they're the second-best
-  // candidates
-  for(int i = 0; i < 3; i++) {
-    if(globalSettings.widgets[i] == WEATHER_CURRENT || globalSettings.widgets[i] == WEATHER_FORECAST_TODAY) {
-      return i;
+uint8_t Sidebar_getVisibleInputs() {
+  // the disconnection icon can replace a widget at any time
+  uint8_t inputs = WIDGET_INPUT_BLUETOOTH;
+
+  // and so can the auto battery widget
+  if(!globalSettings.disableAutobattery && globalSettings.enableAutoBatteryWidget) {
+    inputs |= WIDGET_INPUT_BATTERY;
+  }
+
+  SidebarWidgetType displayWidgets[SIDEBAR_WIDGET_SLOTS];
+  getDisplayedWidgets(displayWidgets);
+
+  for(int i = 0; i < sidebarGeometry.slotCount; i++) {
+    inputs |= getSidebarWidgetByType(displayWidgets[sidebarGeometry.slots[i]])->inputs;
+  }
+
+  return inputs;
+}
+
+/*
+ * Returns whether the widgets of one layer only fit between its top and
+ * bottom in compact mode
+ */
+bool needsCompactMode(int layerIndex, const int heights[SIDEBAR_WIDGET_SLOTS]) {
+  SidebarGeometry* geometry = &sidebarGeometry;
+  int totalHeight = 0;
+  int count = 0;
+
+  for(int i = 0; i < geometry->slotCount; i++) {
+    if(geometry->slotLayers[i] == layerIndex) {
+      totalHeight += heights[i];
+      count++;
     }
   }
 
-  // if we don't have any of those things, just replace the middle widget
-  return 1;
+  int space = geometry->layerBottom[layerIndex] - geometry->layerTop[layerIndex];
+
+  return count > 1 && totalHeight > space - (count - 1) * MIN_WIDGET_GAP;
 }
 
-#endif
+void positionLayerWidgets(int layerIndex, const int heights[SIDEBAR_WIDGET_SLOTS]) {
+  SidebarGeometry* geometry = &sidebarGeometry;
+  int top = geometry->layerTop[layerIndex];
+  int bottom = geometry->layerBottom[layerIndex];
+
+  int count = 0;
+  int totalHeight = 0;
+
+  for(int i = 0; i < geometry->slotCount; i++) {
+    if(geometry->slotLayers[i] == layerIndex) {
+      totalHeight += heights[i];
+      count++;
+    }
+  }
+
+  // each widget goes somewhere between where it would be if they were all
+  // packed at the top and at the bottom, so that the gaps come out equal
+  int index = 0;
+  int heightAbove = 0;
+
+  for(int i = 0; i < geometry->slotCount; i++) {
+    if(geometry->slotLayers[i] != layerIndex) {
+      continue;
+    }
+
+    if(count == 1) {
+      sidebarLayout.positions[i] = (top + bottom) / 2 - heights[i] / 2;
+    } else {
+      int packedTop = top + heightAbove;
+      int packedBottom = bottom - (totalHeight - heightAbove);
+
+      sidebarLayout.positions[i] = ((count - 1 - index) * packedTop + index * packedBottom) / (count - 1);
+    }
+
+    heightAbove += heights[i];
+    index++;
+  }
+}
+
+void updateLayout() {
+  SidebarGeometry* geometry = &sidebarGeometry;
+
+  SidebarWidgetType displayWidgets[SIDEBAR_WIDGET_SLOTS];
+  getDisplayedWidgets(displayWidgets);
+
+  int heights[SIDEBAR_WIDGET_SLOTS];
+
+  for(int i = 0; i < geometry->slotCount; i++) {
+    sidebarLayout.widgets[i] = displayWidgets[geometry->slots[i]];
+    heights[i] = SidebarWidgets_getHeight(getSidebarWidgetByType(sidebarLayout.widgets[i]), false);
+  }
+
+  // if the widgets are too tall, enable "compact mode"
+  sidebarLayout.compactMode = false;
+
+  for(int layer = 0; layer < SIDEBAR_LAYER_COUNT; layer++) {
+    sidebarLayout.compactMode |= needsCompactMode(layer, heights);
+  }
+
+  if(sidebarLayout.compactMode) {
+    for(int i = 0; i < geometry->slotCount; i++) {
+      heights[i] = SidebarWidgets_getHeight(getSidebarWidgetByType(sidebarLayout.widgets[i]), true);
+    }
+  }
+
+  for(int layer = 0; layer < SIDEBAR_LAYER_COUNT; layer++) {
+    positionLayerWidgets(layer, heights);
+  }
+
+  sidebarLayout.valid = true;
+}
+
+void drawSidebarWidgets(GContext* ctx, int layerIndex) {
+  if(!sidebarLayout.valid) {
+    updateLayout();
+  }
+
+  SidebarWidgets_xOffset = sidebarGeometry.layerXOffset[layerIndex];
+  SidebarWidgets_useCompactMode = sidebarLayout.compactMode;
+
+  for(int i = 0; i < sidebarGeometry.slotCount; i++) {
+    if(sidebarGeometry.slotLayers[i] == layerIndex) {
+      getSidebarWidgetByType(sidebarLayout.widgets[i])->draw(ctx, sidebarLayout.positions[i]);
+    }
+  }
+}
 
 #ifdef PBL_ROUND
 
@@ -163,42 +449,30 @@ void updateRoundSidebarRight(Layer *l, GContext* ctx) {
   GRect bounds = layer_get_bounds(l);
   GRect bgBounds = GRect(bounds.origin.x, bounds.size.h / -2, bounds.size.h * 2, bounds.size.h * 2);
 
-  bool showDisconnectIcon = !bluetooth_connection_service_peek();
-  bool showAutoBattery = isAutoBatteryShown();
-
-  SidebarWidgetType displayWidget = globalSettings.widgets[2];
+  Telemetry_layerUpdateStarted(TELEMETRY_LAYER_SIDEBAR_RIGHT);
 
-  if((showAutoBattery || showDisconnectIcon) && getReplacableWidget() == 2) {
-    if(showAutoBattery) {
-      displayWidget = BATTERY_METER;
-    } else if(showDisconnectIcon) {
-      displayWidget = BLUETOOTH_DISCONNECT;
-    }
-  }
+  drawRoundSidebar(ctx, bgBounds, 1);
 
-  drawRoundSidebar(ctx, bgBounds, displayWidget, 3);
+  Telemetry_layerUpdateFinished(TELEMETRY_LAYER_SIDEBAR_RIGHT);
 }
 
 void updateRoundSidebarLeft(Layer *l, GContext* ctx) {
   GRect bounds = layer_get_bounds(l);
   GRect bgBounds = GRect(bounds.origin.x - bounds.size.h * 2 + bounds.size.w, bounds.size.h / -2, bounds.size.h * 2, bounds.size.h * 2);
 
-  bool showDisconnectIcon = !bluetooth_connection_service_peek();
-  bool showAutoBattery = isAutoBatteryShown();
-  SidebarWidgetType displayWidget = globalSettings.widgets[0];
+  Telemetry_layerUpdateStarted(TELEMETRY_LAYER_SIDEBAR);
 
-  if((showAutoBattery || showDisconnectIcon) && getReplacableWidget() == 0) {
-    if(showAutoBattery) {
-      displayWidget = BATTERY_METER;
-    } else if(showDisconnectIcon) {
-      displayWidget = BLUETOOTH_DISCONNECT;
-    }
-  }
+  drawRoundSidebar(ctx, bgBounds, 0);
 
-  drawRoundSidebar(ctx, bgBounds, displayWidget, 7);
+  Telemetry_layerUpdateFinished(TELEMETRY_LAYER_SIDEBAR);
 }
 
-void drawRoundSidebar(GContext* ctx, GRect bgBounds, SidebarWidgetType widgetType, int widgetXOffset) {
+void drawRoundSidebar(GContext* ctx, GRect bgBounds, int layerIndex) {
+  #ifdef TIMESTYLE_BENCHMARK
+    SidebarWidgets_xOffset = sidebarGeometry.layerXOffset[layerIndex];
+    Benchmark_drawStep(ctx);
+  #endif
+
   SidebarWidgets_updateFonts();
 
   graphics_context_set_fill_color(ctx, globalSettings.sidebarColor);
@@ -210,12 +484,7 @@ void drawRoundSidebar(GContext* ctx, GRect bgBounds, SidebarWidgetType widgetTyp
                        DEG_TO_TRIGANGLE(0),
                        TRIG_MAX_ANGLE);
 
-  SidebarWidgets_xOffset = widgetXOffset;
-  SidebarWidget widget = getSidebarWidgetByType(widgetType);
-
-  // calculate center position of the widget
-  int widgetPosition = bgBounds.size.h / 4 - widget.getHeight() / 2;
-  widget.draw(ctx, widgetPosition);
+  drawSidebarWidgets(ctx, layerIndex);
 }
 #endif
 
@@ -224,6 +493,12 @@ void drawRoundSidebar(GContext* ctx, GRect bgBounds, SidebarWidgetType widgetTyp
 
 
 void updateRectSidebar(Layer *l, GContext* ctx) {
+  Telemetry_layerUpdateStarted(TELEMETRY_LAYER_SIDEBAR);
+
+  #ifdef TIMESTYLE_BENCHMARK
+    Benchmark_drawStep(ctx);
+  #endif
+
   SidebarWidgets_updateFonts();
 
   graphics_context_set_fill_color(ctx, globalSettings.sidebarColor);
@@ -231,43 +506,7 @@ void updateRectSidebar(Layer *l, GContext* ctx) {
 
   graphics_context_set_text_color(ctx, globalSettings.sidebarTextColor);
 
-  // if the pebble is disconnected, show the disconnect icon
-  bool showDisconnectIcon = !bluetooth_connection_service_peek();
-  bool showAutoBattery = isAutoBatteryShown();
-
-  SidebarWidget displayWidgets[3];
-
-  displayWidgets[0] = getSidebarWidgetByType(globalSettings.widgets[0]);
-  displayWidgets[1] = getSidebarWidgetByType(globalSettings.widgets[1]);
-  displayWidgets[2] = getSidebarWidgetByType(globalSettings.widgets[2]);
-
-  // do we need to replace a widget?
-  // if so, determine which widget should be replaced
-  if(showAutoBattery || showDisconnectIcon) {
-    int widget_to_replace = getReplacableWidget();
-
-    if(showAutoBattery) {
-      displayWidgets[widget_to_replace] = getSidebarWidgetByType(BATTERY_METER);
-    } else if(showDisconnectIcon) {
-      displayWidgets[widget_to_replace] = getSidebarWidgetByType(BLUETOOTH_DISCONNECT);
-    }
-  }
-
-  // if the widgets are too tall, enable "compact mode"
-  SidebarWidgets_useCompactMode = false; // ensure that we compare the non-compacted heights
-  int totalHeight = displayWidgets[0].getHeight() + displayWidgets[1].getHeight() + displayWidgets[2].getHeight();
-  SidebarWidgets_useCompactMode = (totalHeight > 142) ? true : false;
-
-  // calculate the three widget positions
-  int topWidgetPos = V_PADDING;
-  int lowerWidgetPos = SCREEN_HEIGHT - V_PADDING - displayWidgets[2].getHeight();
-
-  // vertically center the middle widget using MATH
-  int middleWidgetPos = ((lowerWidgetPos - displayWidgets[1].getHeight()) + (topWidgetPos + displayWidgets[0].getHeight())) / 2;
-
-  // draw the widgets
-  displayWidgets[0].draw(ctx, topWidgetPos);
-  displayWidgets[1].draw(ctx, middleWidgetPos);
-  displayWidgets[2].draw(ctx, lowerWidgetPos);
+  drawSidebarWidgets(ctx, 0);
 
+  Telemetry_layerUpdateFinished(TELEMETRY_LAYER_SIDEBAR);
 }
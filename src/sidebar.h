@@ -6,3 +6,21 @@ void Sidebar_init(Window* window);
 void Sidebar_deinit();
 void Sidebar_redraw();
 void Sidebar_updateTime(struct tm* timeInfo);
+
+/*
+ * Redraws the sidebar, but only if one of the changed SidebarWidgetInputs
+ * affects a widget that is currently shown
+ */
+void Sidebar_invalidate(uint8_t changedInputs);
+
+/*
+ * While paused, Sidebar_invalidate only remembers what changed. Unpausing
+ * invalidates everything that changed in the meantime, once
+ */
+void Sidebar_setPaused(bool paused);
+
+/*
+ * Returns all the SidebarWidgetInputs that could change what the sidebar
+ * shows right now
+ */
+uint8_t Sidebar_getVisibleInputs();
@@ -1,19 +1,55 @@
 #include <pebble.h>
-#include <math.h>
 #include "settings.h"
 #include "weather.h"
 #include "languages.h"
 #include "util.h"
 #include "sidebar_widgets.h"
+#include "telemetry.h"
+#include "benchmark.h"
+#include "replay.h"
 
 bool SidebarWidgets_useCompactMode = false;
 int SidebarWidgets_xOffset;
 
-// sidebar icons
-GDrawCommandImage* dateImage;
-GDrawCommandImage* disconnectImage;
-GDrawCommandImage* batteryImage;
-GDrawCommandImage* batteryChargeImage;
+/*
+ * The sidebar icons. Each one is only loaded while a widget that might be
+ * shown needs it, and freed again once nothing references it
+ */
+typedef enum {
+  ICON_DATE,
+  ICON_DISCONNECT,
+  ICON_BATTERY,
+  ICON_BATTERY_CHARGE,
+  #ifdef PBL_HEALTH
+    ICON_SLEEP,
+    ICON_STEPS,
+  #endif
+  ICON_COUNT
+} SidebarIconId;
+
+typedef struct {
+  uint32_t resourceId;
+  bool inverted; // tinted with the fill and stroke colors swapped
+  uint8_t refCount;
+  GDrawCommandImage* image;
+} SidebarIcon;
+
+SidebarIcon sidebarIcons[ICON_COUNT] = {
+  [ICON_DATE]           = { RESOURCE_ID_DATE_BG,        false, 0, NULL },
+  [ICON_DISCONNECT]     = { RESOURCE_ID_DISCONNECTED,   false, 0, NULL },
+  [ICON_BATTERY]        = { RESOURCE_ID_BATTERY_BG,     false, 0, NULL },
+  [ICON_BATTERY_CHARGE] = { RESOURCE_ID_BATTERY_CHARGE, true,  0, NULL }, // the charge "bolt" icon uses inverted colors
+  #ifdef PBL_HEALTH
+    [ICON_SLEEP]        = { RESOURCE_ID_HEALTH_SLEEP,   false, 0, NULL },
+    [ICON_STEPS]        = { RESOURCE_ID_HEALTH_STEPS,   false, 0, NULL },
+  #endif
+};
+
+// the colors the sidebar icons are currently tinted with, so that they only
+// need to be recolored when those colors change
+GColor tintedFillColor;
+GColor tintedStrokeColor;
+bool iconsTinted = false;
 
 // fonts
 GFont smSidebarFont;
@@ -32,122 +68,231 @@ char altClock[8];
 char currentBeats[5];
 
 // the widgets
-SidebarWidget batteryMeterWidget;
 int BatteryMeter_getHeight();
 void BatteryMeter_draw(GContext* ctx, int yPosition);
-
-SidebarWidget emptyWidget;
-int EmptyWidget_getHeight();
 void EmptyWidget_draw(GContext* ctx, int yPosition);
-
-SidebarWidget dateWidget;
-int DateWidget_getHeight();
 void DateWidget_draw(GContext* ctx, int yPosition);
-
-SidebarWidget currentWeatherWidget;
-int CurrentWeather_getHeight();
 void CurrentWeather_draw(GContext* ctx, int yPosition);
-
-SidebarWidget weatherForecastWidget;
-int WeatherForecast_getHeight();
-void WeatherForecast_draw(GContext* ctx, int yPosition);
-
-SidebarWidget btDisconnectWidget;
-int BTDisconnect_getHeight();
 void BTDisconnect_draw(GContext* ctx, int yPosition);
-
-SidebarWidget weekNumberWidget;
-int WeekNumber_getHeight();
 void WeekNumber_draw(GContext* ctx, int yPosition);
-
-SidebarWidget secondsWidget;
-int Seconds_getHeight();
 void Seconds_draw(GContext* ctx, int yPosition);
 
-SidebarWidget altTimeWidget;
-int AltTime_getHeight();
-void AltTime_draw(GContext* ctx, int yPosition);
-
-SidebarWidget beatsWidget;
-int Beats_getHeight();
-void Beats_draw(GContext* ctx, int yPosition);
+// the less common widgets are left out of minimal builds to save memory
+#ifndef TIMESTYLE_MINIMAL
+  void WeatherForecast_draw(GContext* ctx, int yPosition);
+  void AltTime_draw(GContext* ctx, int yPosition);
+  void Beats_draw(GContext* ctx, int yPosition);
+#endif
 
 #ifdef PBL_HEALTH
-  GDrawCommandImage* sleepImage;
-  GDrawCommandImage* stepsImage;
-
-  SidebarWidget healthWidget;
   int Health_getHeight();
   void Health_draw(GContext* ctx, int yPosition);
   void Sleep_draw(GContext* ctx, int yPosition);
   void Steps_draw(GContext* ctx, int yPosition);
 #endif
 
+// heights for widgets that only change with the font size
+#define FONT_HEIGHTS(normal, large) { { normal, normal }, { large, large } }
+
+/*
+ * Every widget, indexed by SidebarWidgetType. Types that don't exist on this
+ * platform are left zeroed, and are shown as the empty widget
+ */
+const SidebarWidget sidebarWidgets[SIDEBAR_WIDGET_TYPE_COUNT] = {
+  [EMPTY] = {
+    .inputs = WIDGET_INPUT_NONE,
+    .heights = FONT_HEIGHTS(0, 0),
+    .draw = EmptyWidget_draw
+  },
+  [BLUETOOTH_DISCONNECT] = {
+    .inputs = WIDGET_INPUT_BLUETOOTH,
+    .heights = FONT_HEIGHTS(22, 22),
+    .draw = BTDisconnect_draw
+  },
+  [BATTERY_METER] = {
+    .inputs = WIDGET_INPUT_BATTERY,
+    .getHeight = BatteryMeter_getHeight,
+    .draw = BatteryMeter_draw
+  },
+  #ifndef TIMESTYLE_MINIMAL
+    [ALT_TIME_ZONE] = {
+      .inputs = WIDGET_INPUT_MINUTE,
+      .heights = FONT_HEIGHTS(26, 29),
+      .draw = AltTime_draw
+    },
+  #endif
+  [DATE] = {
+    .inputs = WIDGET_INPUT_DAY,
+    .heights = { { 58, 41 }, { 62, 42 } },
+    .draw = DateWidget_draw
+  },
+  [SECONDS] = {
+    .inputs = WIDGET_INPUT_SECONDS,
+    .heights = FONT_HEIGHTS(14, 14),
+    .draw = Seconds_draw
+  },
+  [WEEK_NUMBER] = {
+    .inputs = WIDGET_INPUT_DAY,
+    .heights = FONT_HEIGHTS(26, 29),
+    .draw = WeekNumber_draw
+  },
+  [WEATHER_CURRENT] = {
+    .inputs = WIDGET_INPUT_WEATHER,
+    .heights = FONT_HEIGHTS(42, 44),
+    .draw = CurrentWeather_draw
+  },
+  #ifndef TIMESTYLE_MINIMAL
+    [WEATHER_FORECAST_TODAY] = {
+      .inputs = WIDGET_INPUT_WEATHER,
+      .heights = FONT_HEIGHTS(60, 63),
+      .draw = WeatherForecast_draw
+    },
+  #endif
+  #ifdef PBL_HEALTH
+    [HEALTH] = {
+      .inputs = WIDGET_INPUT_HEALTH,
+      .getHeight = Health_getHeight,
+      .draw = Health_draw
+    },
+  #endif
+  #ifndef TIMESTYLE_MINIMAL
+    [BEATS] = {
+      .inputs = WIDGET_INPUT_MINUTE,
+      .heights = FONT_HEIGHTS(26, 29),
+      .draw = Beats_draw
+    },
+  #endif
+};
+
 void SidebarWidgets_init() {
   // load fonts
   smSidebarFont = fonts_get_system_font(FONT_KEY_GOTHIC_14_BOLD);
   mdSidebarFont = fonts_get_system_font(FONT_KEY_GOTHIC_18_BOLD);
   lgSidebarFont = fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD);
 
-  // load the sidebar graphics
-  dateImage = gdraw_command_image_create_with_resource(RESOURCE_ID_DATE_BG);
-  disconnectImage = gdraw_command_image_create_with_resource(RESOURCE_ID_DISCONNECTED);
-  batteryImage = gdraw_command_image_create_with_resource(RESOURCE_ID_BATTERY_BG);
-  batteryChargeImage = gdraw_command_image_create_with_resource(RESOURCE_ID_BATTERY_CHARGE);
+  // the day and month names and such
+  Languages_load(globalSettings.languageId);
 
-  #ifdef PBL_HEALTH
-    sleepImage = gdraw_command_image_create_with_resource(RESOURCE_ID_HEALTH_SLEEP);
-    stepsImage = gdraw_command_image_create_with_resource(RESOURCE_ID_HEALTH_STEPS);
-  #endif
+  // load the sidebar graphics needed by the current widgets
+  SidebarWidgets_updateLoadedIcons();
+}
+
+void tintSidebarIcon(SidebarIcon* icon, GColor fill, GColor stroke);
+
+void SidebarWidgets_updateIconColors() {
+  // the icons are tinted already, nothing to do
+  if(iconsTinted &&
+     gcolor_equal(tintedFillColor, globalSettings.iconFillColor) &&
+     gcolor_equal(tintedStrokeColor, globalSettings.iconStrokeColor)) {
+    return;
+  }
+
+  GColor fill = globalSettings.iconFillColor;
+  GColor stroke = globalSettings.iconStrokeColor;
 
-  // set up widgets' function pointers correctly
-  batteryMeterWidget.getHeight = BatteryMeter_getHeight;
-  batteryMeterWidget.draw      = BatteryMeter_draw;
+  for(int i = 0; i < ICON_COUNT; i++) {
+    tintSidebarIcon(&sidebarIcons[i], fill, stroke);
+  }
+
+  tintedFillColor = fill;
+  tintedStrokeColor = stroke;
+  iconsTinted = true;
+}
 
-  emptyWidget.getHeight = EmptyWidget_getHeight;
-  emptyWidget.draw      = EmptyWidget_draw;
+void SidebarWidgets_deinit() {
+  for(int i = 0; i < ICON_COUNT; i++) {
+    gdraw_command_image_destroy(sidebarIcons[i].image);
+    sidebarIcons[i].image = NULL;
+    sidebarIcons[i].refCount = 0;
+  }
+}
+
+void tintSidebarIcon(SidebarIcon* icon, GColor fill, GColor stroke) {
+  if(icon->image) {
+    if(icon->inverted) {
+      gdraw_command_image_recolor(icon->image, stroke, fill);
+    } else {
+      gdraw_command_image_recolor(icon->image, fill, stroke);
+    }
+  }
+}
 
-  dateWidget.getHeight = DateWidget_getHeight;
-  dateWidget.draw      = DateWidget_draw;
+/*
+ * Adds a reference to each icon used by the specified widget type
+ */
+void acquireWidgetIcons(SidebarWidgetType type) {
+  switch(type) {
+    case BATTERY_METER:
+      sidebarIcons[ICON_BATTERY].refCount++;
+      sidebarIcons[ICON_BATTERY_CHARGE].refCount++;
+      break;
+    case BLUETOOTH_DISCONNECT:
+      sidebarIcons[ICON_DISCONNECT].refCount++;
+      break;
+    case DATE:
+      sidebarIcons[ICON_DATE].refCount++;
+      break;
+    #ifdef PBL_HEALTH
+      case HEALTH:
+        sidebarIcons[ICON_SLEEP].refCount++;
+        sidebarIcons[ICON_STEPS].refCount++;
+        break;
+    #endif
+    default:
+      break;
+  }
+}
 
-  currentWeatherWidget.getHeight = CurrentWeather_getHeight;
-  currentWeatherWidget.draw      = CurrentWeather_draw;
+void SidebarWidgets_updateLoadedIcons() {
+  for(int i = 0; i < ICON_COUNT; i++) {
+    sidebarIcons[i].refCount = 0;
+  }
 
-  weatherForecastWidget.getHeight = WeatherForecast_getHeight;
-  weatherForecastWidget.draw      = WeatherForecast_draw;
+  bool currentWeatherShown = false;
+  bool weatherForecastShown = false;
 
-  btDisconnectWidget.getHeight = BTDisconnect_getHeight;
-  btDisconnectWidget.draw      = BTDisconnect_draw;
+  for(int i = 0; i < SIDEBAR_WIDGET_SLOTS; i++) {
+    #ifdef PBL_ROUND
+      // the round sidebar only shows the first and last widgets
+      if(i != 0 && i != SIDEBAR_WIDGET_SLOTS - 1) {
+        continue;
+      }
+    #endif
 
-  weekNumberWidget.getHeight = WeekNumber_getHeight;
-  weekNumberWidget.draw      = WeekNumber_draw;
+    acquireWidgetIcons(globalSettings.widgets[i]);
 
-  secondsWidget.getHeight = Seconds_getHeight;
-  secondsWidget.draw      = Seconds_draw;
+    currentWeatherShown |= (globalSettings.widgets[i] == WEATHER_CURRENT);
+    #ifndef TIMESTYLE_MINIMAL
+      weatherForecastShown |= (globalSettings.widgets[i] == WEATHER_FORECAST_TODAY);
+    #endif
+  }
 
-  altTimeWidget.getHeight = AltTime_getHeight;
-  altTimeWidget.draw      = AltTime_draw;
+  // the disconnection icon can replace a widget at any time
+  acquireWidgetIcons(BLUETOOTH_DISCONNECT);
 
-  #ifdef PBL_HEALTH
-    healthWidget.getHeight = Health_getHeight;
-    healthWidget.draw = Health_draw;
-  #endif
+  // and so can the auto battery widget, if it's enabled
+  if(!globalSettings.disableAutobattery && globalSettings.enableAutoBatteryWidget) {
+    acquireWidgetIcons(BATTERY_METER);
+  }
 
-  beatsWidget.getHeight = Beats_getHeight;
-  beatsWidget.draw      = Beats_draw;
+  for(int i = 0; i < ICON_COUNT; i++) {
+    SidebarIcon* icon = &sidebarIcons[i];
 
-}
+    if(icon->refCount > 0 && !icon->image) {
+      icon->image = gdraw_command_image_create_with_resource(icon->resourceId);
+      Telemetry_countResourceLoad();
+      tintSidebarIcon(icon, globalSettings.iconFillColor, globalSettings.iconStrokeColor);
+    } else if(icon->refCount == 0 && icon->image) {
+      gdraw_command_image_destroy(icon->image);
+      icon->image = NULL;
+    }
+  }
 
-void SidebarWidgets_deinit() {
-  gdraw_command_image_destroy(dateImage);
-  gdraw_command_image_destroy(disconnectImage);
-  gdraw_command_image_destroy(batteryImage);
-  gdraw_command_image_destroy(batteryChargeImage);
+  // the new icons were tinted with the current colors, retint the rest if needed
+  SidebarWidgets_updateIconColors();
 
-  #ifdef PBL_HEALTH
-    gdraw_command_image_destroy(stepsImage);
-    gdraw_command_image_destroy(sleepImage);
-  #endif
+  // the weather icons are managed by the weather module
+  Weather_setIconsEnabled(currentWeatherShown, weatherForecastShown);
 }
 
 void SidebarWidgets_updateFonts() {
@@ -160,6 +305,13 @@ void SidebarWidgets_updateFonts() {
   }
 }
 
+// rounds half away from zero like roundf did, without pulling in float code
+int celsiusToFahrenheit(int celsius) {
+  int tenths = celsius * 18 + 320;
+
+  return (tenths >= 0) ? (tenths + 5) / 10 : (tenths - 5) / 10;
+}
+
 // c can't do true modulus on negative numbers, apparently
 // from http://stackoverflow.com/questions/11720656/modulo-operation-with-negative-numbers
 int mod(int a, int b) {
@@ -167,103 +319,114 @@ int mod(int a, int b) {
     return r < 0 ? r + b : r;
 }
 
-void SidebarWidgets_updateTime(struct tm* timeInfo) {
-  printf("Current RAM: %d", heap_bytes_free());
+/*
+ * Everything the cached time strings were computed from, so that each tick
+ * only has to redo the strings whose inputs actually changed
+ */
+int lastDay = -1;
+int lastHour = -1;
+int lastBeats = -1;
+uint8_t lastLanguageId;
+int lastAltclockOffset;
+bool lastShowLeadingZero;
+bool lastClockIs24h;
 
-  // set all the date strings
-  strftime(currentDayNum,  3, "%e", timeInfo);
-  strftime(currentWeekNum, 3, "%V", timeInfo);
+void SidebarWidgets_updateTime(struct tm* timeInfo) {
+  LOG(APP_LOG_LEVEL_DEBUG, "Current RAM: %d", (int)heap_bytes_free());
+
+  // these settings affect the time strings, so start over if they've changed
+  bool clockIs24h = clock_is_24h_style();
+
+  if(globalSettings.languageId != lastLanguageId ||
+     globalSettings.altclockOffset != lastAltclockOffset ||
+     globalSettings.showLeadingZero != lastShowLeadingZero ||
+     clockIs24h != lastClockIs24h) {
+    lastDay = -1;
+    lastHour = -1;
+
+    lastLanguageId = globalSettings.languageId;
+    lastAltclockOffset = globalSettings.altclockOffset;
+    lastShowLeadingZero = globalSettings.showLeadingZero;
+    lastClockIs24h = clockIs24h;
+  }
 
   // set the seconds string
-  strftime(currentSecondsNum, 4, ":%S", timeInfo);
-
+  currentSecondsNum[0] = ':';
+  int_to_str(currentSecondsNum + 1, sizeof(currentSecondsNum) - 1, timeInfo->tm_sec, 2);
 
-  // set the alternate time zone string
-  int hour = timeInfo->tm_hour;
+  // set all the date strings, which only change once per day
+  if(timeInfo->tm_mday != lastDay) {
+    int_to_str(currentDayNum, sizeof(currentDayNum), timeInfo->tm_mday, 1);
+    int_to_str(currentWeekNum, sizeof(currentWeekNum), time_get_iso_week(timeInfo), 2);
 
-  // apply the configured offset value
-  hour += globalSettings.altclockOffset;
+    Languages_load(globalSettings.languageId);
 
-  char am_pm = (mod(hour, 24) < 12) ? 'a' : 'p';
+    strncpy(currentDayName, Languages_current.dayNames[timeInfo->tm_wday], sizeof(currentDayName));
+    strncpy(currentMonth, Languages_current.monthNames[timeInfo->tm_mon], sizeof(currentMonth));
 
-  // format it
-  if(clock_is_24h_style()) {
-    hour = mod(hour, 24);
-    am_pm = (char) 0;
-  } else {
-    hour = mod(hour, 12);
-    if(hour == 0) {
-      hour = 12;
-    }
+    lastDay = timeInfo->tm_mday;
   }
 
-  if(globalSettings.showLeadingZero && hour < 10) {
-    snprintf(altClock, sizeof(altClock), "0%i%c", hour, am_pm);
-  } else {
-    snprintf(altClock, sizeof(altClock), "%i%c", hour, am_pm);
-  }
+  // the alternate time zone and beats widgets are left out of minimal builds
+  #ifndef TIMESTYLE_MINIMAL
+    // set the alternate time zone string, which only shows the hour
+    if(timeInfo->tm_hour != lastHour) {
+      int hour = timeInfo->tm_hour;
 
-  strncpy(currentDayName, dayNames[globalSettings.languageId][timeInfo->tm_wday], sizeof(currentDayName));
-  strncpy(currentMonth, monthNames[globalSettings.languageId][timeInfo->tm_mon], sizeof(currentMonth));
+      // apply the configured offset value
+      hour += globalSettings.altclockOffset;
 
-  // remove padding on date num, if needed
-  if(currentDayNum[0] == ' ') {
-    currentDayNum[0] = currentDayNum[1];
-    currentDayNum[1] = '\0';
-  }
+      char am_pm = (mod(hour, 24) < 12) ? 'a' : 'p';
 
-  // this must be last, because time_get_beats screws with the time structure
-  // TODO: make that function less messy
-  int beats = time_get_beats(timeInfo);
+      // format it
+      if(clockIs24h) {
+        hour = mod(hour, 24);
+        am_pm = (char) 0;
+      } else {
+        hour = mod(hour, 12);
+        if(hour == 0) {
+          hour = 12;
+        }
+      }
 
-  // set the swatch internet time beats
-  snprintf(currentBeats, sizeof(currentBeats), "%i", beats);
+      int length = int_to_str(altClock, sizeof(altClock), hour, (globalSettings.showLeadingZero) ? 2 : 1);
 
+      altClock[length] = am_pm;
+      altClock[length + 1] = '\0';
+
+      lastHour = timeInfo->tm_hour;
+    }
+
+    // set the swatch internet time beats, which change every 86.4 seconds
+    int beats = time_get_beats(time(NULL));
+
+    if(beats != lastBeats) {
+      int_to_str(currentBeats, sizeof(currentBeats), beats, 1);
+
+      lastBeats = beats;
+    }
+  #endif
 }
 
 /* Sidebar Widget Selection */
-SidebarWidget getSidebarWidgetByType(SidebarWidgetType type) {
-  switch(type) {
-    case BATTERY_METER:
-      return batteryMeterWidget;
-      break;
-    case BLUETOOTH_DISCONNECT:
-      return btDisconnectWidget;
-      break;
-    case DATE:
-      return dateWidget;
-      break;
-    case ALT_TIME_ZONE:
-      return altTimeWidget;
-      break;
-    case SECONDS:
-      return secondsWidget;
-      break;
-    case WEATHER_CURRENT:
-      return currentWeatherWidget;
-      break;
-    case WEATHER_FORECAST_TODAY:
-      return weatherForecastWidget;
-      break;
-    case WEEK_NUMBER:
-      return weekNumberWidget;
-    #ifdef PBL_HEALTH
-      case HEALTH:
-        return healthWidget;
-    #endif
-    case BEATS:
-      return beatsWidget;
-    default:
-      return emptyWidget;
-      break;
+const SidebarWidget* getSidebarWidgetByType(SidebarWidgetType type) {
+  // unknown types (and ones this platform doesn't have) are just empty
+  if(type >= SIDEBAR_WIDGET_TYPE_COUNT || !sidebarWidgets[type].draw) {
+    return &sidebarWidgets[EMPTY];
   }
+
+  return &sidebarWidgets[type];
 }
 
-/********** functions for the empty widget **********/
-int EmptyWidget_getHeight() {
-  return 0;
+int SidebarWidgets_getHeight(const SidebarWidget* widget, bool compactMode) {
+  if(widget->getHeight) {
+    return widget->getHeight();
+  }
+
+  return widget->heights[globalSettings.useLargeFonts ? 1 : 0][compactMode ? 1 : 0];
 }
 
+/********** functions for the empty widget **********/
 void EmptyWidget_draw(GContext* ctx, int yPosition) {
   return;
 }
@@ -290,20 +453,17 @@ void BatteryMeter_draw(GContext* ctx, int yPosition) {
   char batteryString[6];
   int batteryPositionY = yPosition - 5; // correct for vertical empty space on battery icon
 
-  if (batteryImage) {
-    gdraw_command_image_recolor(batteryImage, globalSettings.iconFillColor, globalSettings.iconStrokeColor);
-    gdraw_command_image_draw(ctx, batteryImage, GPoint(3 + SidebarWidgets_xOffset, batteryPositionY));
+  if (sidebarIcons[ICON_BATTERY].image) {
+    gdraw_command_image_draw(ctx, sidebarIcons[ICON_BATTERY].image, GPoint(3 + SidebarWidgets_xOffset, batteryPositionY));
   }
 
   if(chargeState.is_charging) {
-    if(batteryChargeImage) {
-      // the charge "bolt" icon uses inverted colors
-      gdraw_command_image_recolor(batteryChargeImage, globalSettings.iconStrokeColor, globalSettings.iconFillColor);
-      gdraw_command_image_draw(ctx, batteryChargeImage, GPoint(3 + SidebarWidgets_xOffset, batteryPositionY));
+    if(sidebarIcons[ICON_BATTERY_CHARGE].image) {
+      gdraw_command_image_draw(ctx, sidebarIcons[ICON_BATTERY_CHARGE].image, GPoint(3 + SidebarWidgets_xOffset, batteryPositionY));
     }
   } else {
 
-    int width = roundf(18 * battery_percent / 100.0f);
+    int width = (18 * battery_percent + 50) / 100;
 
     graphics_context_set_fill_color(ctx, globalSettings.iconStrokeColor);
 
@@ -321,9 +481,11 @@ void BatteryMeter_draw(GContext* ctx, int yPosition) {
   if(globalSettings.showBatteryPct && !chargeState.is_charging) {
     if(!globalSettings.useLargeFonts) {
       // put the percent sign on the opposite side if turkish
-      snprintf(batteryString, sizeof(batteryString),
-               (globalSettings.languageId == LANGUAGE_TR) ? "%%%d" : "%d%%",
-               battery_percent);
+      if(globalSettings.languageId == LANGUAGE_TR) {
+        format_int(batteryString, sizeof(batteryString), "%", battery_percent, "");
+      } else {
+        format_int(batteryString, sizeof(batteryString), "", battery_percent, "%");
+      }
 
       graphics_draw_text(ctx,
                          batteryString,
@@ -333,7 +495,7 @@ void BatteryMeter_draw(GContext* ctx, int yPosition) {
                          GTextAlignmentCenter,
                          NULL);
     } else {
-      snprintf(batteryString, sizeof(batteryString), "%d", battery_percent);
+      int_to_str(batteryString, sizeof(batteryString), battery_percent, 1);
 
       graphics_draw_text(ctx,
                          batteryString,
@@ -348,14 +510,6 @@ void BatteryMeter_draw(GContext* ctx, int yPosition) {
 
 /********** current date widget **********/
 
-int DateWidget_getHeight() {
-  if(globalSettings.useLargeFonts) {
-    return (SidebarWidgets_useCompactMode) ? 42 : 62;
-  } else  {
-    return (SidebarWidgets_useCompactMode) ? 41 : 58;
-  }
-}
-
 void DateWidget_draw(GContext* ctx, int yPosition) {
   graphics_context_set_text_color(ctx, globalSettings.sidebarTextColor);
 
@@ -374,9 +528,8 @@ void DateWidget_draw(GContext* ctx, int yPosition) {
   // next, draw the date background
   // (an image in normal mode, a rectangle in large font mode)
   if(!globalSettings.useLargeFonts) {
-    if(dateImage) {
-      gdraw_command_image_recolor(dateImage, globalSettings.iconFillColor, globalSettings.iconStrokeColor);
-      gdraw_command_image_draw(ctx, dateImage, GPoint(3 + SidebarWidgets_xOffset, yPosition + 23));
+    if(sidebarIcons[ICON_DATE].image) {
+      gdraw_command_image_draw(ctx, sidebarIcons[ICON_DATE].image, GPoint(3 + SidebarWidgets_xOffset, yPosition + 23));
     }
   } else {
     graphics_context_set_fill_color(ctx, globalSettings.iconStrokeColor);
@@ -422,20 +575,10 @@ void DateWidget_draw(GContext* ctx, int yPosition) {
 
 /********** current weather widget **********/
 
-int CurrentWeather_getHeight() {
-  if(globalSettings.useLargeFonts) {
-    return 44;
-  } else {
-    return 42;
-  }
-}
-
 void CurrentWeather_draw(GContext* ctx, int yPosition) {
   graphics_context_set_text_color(ctx, globalSettings.sidebarTextColor);
 
   if (Weather_currentWeatherIcon) {
-    gdraw_command_image_recolor(Weather_currentWeatherIcon, globalSettings.iconFillColor, globalSettings.iconStrokeColor);
-
     gdraw_command_image_draw(ctx, Weather_currentWeatherIcon, GPoint(3 + SidebarWidgets_xOffset, yPosition));
   }
 
@@ -445,14 +588,14 @@ void CurrentWeather_draw(GContext* ctx, int yPosition) {
     int currentTemp = Weather_weatherInfo.currentTemp;
 
     if(!globalSettings.useMetric) {
-      currentTemp = roundf(currentTemp * 1.8f + 32);
+      currentTemp = celsiusToFahrenheit(currentTemp);
     }
 
     char tempString[8];
 
     // in large font mode, omit the degree symbol and move the text
     if(!globalSettings.useLargeFonts) {
-      snprintf(tempString, sizeof(tempString), " %d°", currentTemp);
+      format_int(tempString, sizeof(tempString), " ", currentTemp, "°");
 
       graphics_draw_text(ctx,
                          tempString,
@@ -462,7 +605,7 @@ void CurrentWeather_draw(GContext* ctx, int yPosition) {
                          GTextAlignmentCenter,
                          NULL);
     } else {
-      snprintf(tempString, sizeof(tempString), " %d", currentTemp);
+      format_int(tempString, sizeof(tempString), " ", currentTemp, "");
 
       graphics_draw_text(ctx,
                          tempString,
@@ -486,32 +629,21 @@ void CurrentWeather_draw(GContext* ctx, int yPosition) {
 
 /***** Bluetooth Disconnection Widget *****/
 
-int BTDisconnect_getHeight() {
-  return 22;
-}
-
 void BTDisconnect_draw(GContext* ctx, int yPosition) {
-  if(disconnectImage) {
-    gdraw_command_image_recolor(disconnectImage, globalSettings.iconFillColor, globalSettings.iconStrokeColor);
-
-
-    gdraw_command_image_draw(ctx, disconnectImage, GPoint(3 + SidebarWidgets_xOffset, yPosition));
+  if(sidebarIcons[ICON_DISCONNECT].image) {
+    gdraw_command_image_draw(ctx, sidebarIcons[ICON_DISCONNECT].image, GPoint(3 + SidebarWidgets_xOffset, yPosition));
   }
 }
 
 /***** Week Number Widget *****/
 
-int WeekNumber_getHeight() {
-  return (globalSettings.useLargeFonts) ? 29 : 26;
-}
-
 void WeekNumber_draw(GContext* ctx, int yPosition) {
   graphics_context_set_text_color(ctx, globalSettings.sidebarTextColor);
 
   // note that it draws "above" the y position to correct for
   // the vertical padding
   graphics_draw_text(ctx,
-                     wordForWeek[globalSettings.languageId],
+                     Languages_current.wordForWeek,
                      smSidebarFont,
                      GRect(-4 + SidebarWidgets_xOffset, yPosition - 4, 38, 20),
                      GTextOverflowModeFill,
@@ -539,10 +671,6 @@ void WeekNumber_draw(GContext* ctx, int yPosition) {
 
 /***** Seconds Widget *****/
 
-int Seconds_getHeight() {
-  return 14;
-}
-
 void Seconds_draw(GContext* ctx, int yPosition) {
   graphics_context_set_text_color(ctx, globalSettings.sidebarTextColor);
 
@@ -555,22 +683,14 @@ void Seconds_draw(GContext* ctx, int yPosition) {
                      NULL);
 }
 
-/***** Weather Forecast Widget *****/
+#ifndef TIMESTYLE_MINIMAL
 
-int WeatherForecast_getHeight() {
-  if(globalSettings.useLargeFonts) {
-    return 63;
-  } else {
-    return 60;
-  }
-}
+/***** Weather Forecast Widget *****/
 
 void WeatherForecast_draw(GContext* ctx, int yPosition) {
   graphics_context_set_text_color(ctx, globalSettings.sidebarTextColor);
 
   if(Weather_forecastWeatherIcon) {
-    gdraw_command_image_recolor(Weather_forecastWeatherIcon, globalSettings.iconFillColor, globalSettings.iconStrokeColor);
-
     gdraw_command_image_draw(ctx, Weather_forecastWeatherIcon, GPoint(3 + SidebarWidgets_xOffset, yPosition));
   }
 
@@ -581,8 +701,8 @@ void WeatherForecast_draw(GContext* ctx, int yPosition) {
     int lowTemp  = Weather_weatherForecast.lowTemp;
 
     if(!globalSettings.useMetric) {
-      highTemp = roundf(highTemp * 1.8f + 32);
-      lowTemp  = roundf(lowTemp * 1.8f + 32);
+      highTemp = celsiusToFahrenheit(highTemp);
+      lowTemp  = celsiusToFahrenheit(lowTemp);
     }
 
     char tempString[8];
@@ -591,7 +711,7 @@ void WeatherForecast_draw(GContext* ctx, int yPosition) {
 
     // in large font mode, omit the degree symbol and move the text
     if(!globalSettings.useLargeFonts) {
-      snprintf(tempString, sizeof(tempString), " %d°", highTemp);
+      format_int(tempString, sizeof(tempString), " ", highTemp, "°");
 
       graphics_draw_text(ctx,
                          tempString,
@@ -603,7 +723,7 @@ void WeatherForecast_draw(GContext* ctx, int yPosition) {
 
       graphics_fill_rect(ctx, GRect(3 + SidebarWidgets_xOffset, 8 + yPosition + 37, 24, 1), 0, GCornerNone);
 
-      snprintf(tempString, sizeof(tempString), " %d°", lowTemp);
+      format_int(tempString, sizeof(tempString), " ", lowTemp, "°");
 
       graphics_draw_text(ctx,
                          tempString,
@@ -613,7 +733,7 @@ void WeatherForecast_draw(GContext* ctx, int yPosition) {
                          GTextAlignmentCenter,
                          NULL);
     } else {
-      snprintf(tempString, sizeof(tempString), "%d", highTemp);
+      int_to_str(tempString, sizeof(tempString), highTemp, 1);
 
       graphics_draw_text(ctx,
                          tempString,
@@ -625,7 +745,7 @@ void WeatherForecast_draw(GContext* ctx, int yPosition) {
 
       graphics_fill_rect(ctx, GRect(3 + SidebarWidgets_xOffset, 8 + yPosition + 38, 24, 1), 0, GCornerNone);
 
-      snprintf(tempString, sizeof(tempString), "%d", lowTemp);
+      int_to_str(tempString, sizeof(tempString), lowTemp, 1);
 
       graphics_draw_text(ctx,
                          tempString,
@@ -649,10 +769,6 @@ void WeatherForecast_draw(GContext* ctx, int yPosition) {
 
 /***** Alternate Time Zone Widget *****/
 
-int AltTime_getHeight() {
-  return (globalSettings.useLargeFonts) ? 29 : 26;
-}
-
 void AltTime_draw(GContext* ctx, int yPosition) {
   graphics_context_set_text_color(ctx, globalSettings.sidebarTextColor);
 
@@ -675,6 +791,8 @@ void AltTime_draw(GContext* ctx, int yPosition) {
                      NULL);
 }
 
+#endif
+
 /***** Health Widget *****/
 
 #ifdef PBL_HEALTH
@@ -701,9 +819,8 @@ void Health_draw(GContext* ctx, int yPosition) {
 }
 
 void Sleep_draw(GContext* ctx, int yPosition) {
-  if(sleepImage) {
-    gdraw_command_image_recolor(sleepImage, globalSettings.iconFillColor, globalSettings.iconStrokeColor);
-    gdraw_command_image_draw(ctx, sleepImage, GPoint(3 + SidebarWidgets_xOffset, yPosition - 7));
+  if(sidebarIcons[ICON_SLEEP].image) {
+    gdraw_command_image_draw(ctx, sidebarIcons[ICON_SLEEP].image, GPoint(3 + SidebarWidgets_xOffset, yPosition - 7));
   }
 
   // get sleep in seconds
@@ -726,7 +843,7 @@ void Sleep_draw(GContext* ctx, int yPosition) {
 
   char sleep_text[4];
 
-  snprintf(sleep_text, sizeof(sleep_text), "%ih", sleep_hours);
+  format_int(sleep_text, sizeof(sleep_text), "", sleep_hours, "h");
 
   graphics_context_set_text_color(ctx, globalSettings.sidebarTextColor);
   graphics_draw_text(ctx,
@@ -737,7 +854,7 @@ void Sleep_draw(GContext* ctx, int yPosition) {
                      GTextAlignmentCenter,
                      NULL);
 
-  snprintf(sleep_text, sizeof(sleep_text), "%im", sleep_minutes);
+  format_int(sleep_text, sizeof(sleep_text), "", sleep_minutes, "m");
 
   graphics_draw_text(ctx,
                      sleep_text,
@@ -751,9 +868,8 @@ void Sleep_draw(GContext* ctx, int yPosition) {
 
 void Steps_draw(GContext* ctx, int yPosition) {
 
-  if(stepsImage) {
-    gdraw_command_image_recolor(stepsImage, globalSettings.iconFillColor, globalSettings.iconStrokeColor);
-    gdraw_command_image_draw(ctx, stepsImage, GPoint(3 + SidebarWidgets_xOffset, yPosition - 7));
+  if(sidebarIcons[ICON_STEPS].image) {
+    gdraw_command_image_draw(ctx, sidebarIcons[ICON_STEPS].image, GPoint(3 + SidebarWidgets_xOffset, yPosition - 7));
   }
 
   char steps_text[8];
@@ -771,10 +887,10 @@ void Steps_draw(GContext* ctx, int yPosition) {
     // format distance string
     if(unit_system == MeasurementSystemMetric) {
       if(distance < 100) {
-        snprintf(steps_text, sizeof(steps_text), "%im", distance);
+        format_int(steps_text, sizeof(steps_text), "", distance, "m");
       } else if(distance < 1000) {
         distance /= 100; // convert to tenths of km
-        snprintf(steps_text, sizeof(steps_text), ".%ikm", distance);
+        format_int(steps_text, sizeof(steps_text), ".", distance, "km");
       } else {
         distance /= 1000; // convert to km
 
@@ -782,16 +898,18 @@ void Steps_draw(GContext* ctx, int yPosition) {
           use_small_font = true;
         }
 
-        snprintf(steps_text, sizeof(steps_text), "%ikm", distance);
+        format_int(steps_text, sizeof(steps_text), "", distance, "km");
       }
     } else {
       int miles_tenths = distance * 10 / 1609 % 10;
-      int miles_whole  = (int)roundf(distance / 1609.0f);
+      int miles_whole  = (distance + 1609 / 2) / 1609;
 
       if(miles_whole > 0) {
-        snprintf(steps_text, sizeof(steps_text), "%imi", miles_whole);
+        format_int(steps_text, sizeof(steps_text), "", miles_whole, "mi");
       } else {
-        snprintf(steps_text, sizeof(steps_text), "%c%imi", globalSettings.decimalSeparator, miles_tenths);
+        char separator[2] = { globalSettings.decimalSeparator, '\0' };
+
+        format_int(steps_text, sizeof(steps_text), separator, miles_tenths, "mi");
       }
     }
   } else {
@@ -803,15 +921,18 @@ void Steps_draw(GContext* ctx, int yPosition) {
 
     // format step string
     if(steps < 1000) {
-      snprintf(steps_text, sizeof(steps_text), "%i", steps);
+      int_to_str(steps_text, sizeof(steps_text), steps, 1);
     } else {
       int steps_thousands = steps / 1000;
       int steps_hundreds  = steps / 100 % 10;
 
       if (steps < 10000) {
-        snprintf(steps_text, sizeof(steps_text), "%i%c%ik", steps_thousands, globalSettings.decimalSeparator, steps_hundreds);
+        char separator[2] = { globalSettings.decimalSeparator, '\0' };
+        int length = format_int(steps_text, sizeof(steps_text), "", steps_thousands, separator);
+
+        format_int(steps_text + length, sizeof(steps_text) - length, "", steps_hundreds, "k");
       } else {
-        snprintf(steps_text, sizeof(steps_text), "%ik", steps_thousands);
+        format_int(steps_text, sizeof(steps_text), "", steps_thousands, "k");
       }
     }
   }
@@ -832,9 +953,7 @@ void Steps_draw(GContext* ctx, int yPosition) {
 
 /***** Beats (Swatch Internet Time) widget *****/
 
-int Beats_getHeight() {
-  return (globalSettings.useLargeFonts) ? 29 : 26;
-}
+#ifndef TIMESTYLE_MINIMAL
 
 void Beats_draw(GContext* ctx, int yPosition) {
   graphics_context_set_text_color(ctx, globalSettings.sidebarTextColor);
@@ -857,3 +976,5 @@ void Beats_draw(GContext* ctx, int yPosition) {
                      GTextAlignmentCenter,
                      NULL);
 }
+
+#endif
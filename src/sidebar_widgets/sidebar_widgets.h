@@ -30,13 +30,39 @@ typedef enum {
   WEATHER_FORECAST_TODAY    = 8,
   TIME_UNUSED               = 9,
   HEALTH                    = 10,
-  BEATS                     = 11
+  BEATS                     = 11,
+  SIDEBAR_WIDGET_TYPE_COUNT
 } SidebarWidgetType;
 
+/*
+ * The inputs that a widget's contents can depend on. The sidebar uses these to
+ * skip redraws when nothing that the visible widgets show has changed
+ */
+typedef enum {
+  WIDGET_INPUT_NONE         = 0,
+  WIDGET_INPUT_SECONDS      = 1 << 0,
+  WIDGET_INPUT_MINUTE       = 1 << 1,
+  WIDGET_INPUT_DAY          = 1 << 2,
+  WIDGET_INPUT_BATTERY      = 1 << 3,
+  WIDGET_INPUT_BLUETOOTH    = 1 << 4,
+  WIDGET_INPUT_WEATHER      = 1 << 5,
+  WIDGET_INPUT_HEALTH       = 1 << 6
+} SidebarWidgetInput;
+
 typedef struct {
   /*
-   * Returns the pixel height of the widget, taking into account all current
-   * settings that would affect this, such as font size
+   * Which SidebarWidgetInputs affect what the widget draws
+   */
+  uint8_t inputs;
+
+  /*
+   * The pixel height of the widget, indexed by [useLargeFonts][compact mode]
+   */
+  uint8_t heights[2][2];
+
+  /*
+   * Returns the pixel height of widgets whose height also depends on what
+   * they show (such as whether the battery is charging), NULL for the rest
    */
   int (*getHeight)();
 
@@ -48,6 +74,23 @@ typedef struct {
 
 void SidebarWidgets_init();
 void SidebarWidgets_deinit();
-SidebarWidget getSidebarWidgetByType(SidebarWidgetType type);
+const SidebarWidget* getSidebarWidgetByType(SidebarWidgetType type);
+
+/*
+ * Returns the pixel height of the widget with the current font size
+ */
+int SidebarWidgets_getHeight(const SidebarWidget* widget, bool compactMode);
 void SidebarWidgets_updateFonts();
+
+/*
+ * Recolors the sidebar icons if the icon colors have changed since they were
+ * last tinted, so that drawing them never has to
+ */
+void SidebarWidgets_updateIconColors();
+
+/*
+ * Loads the icons needed by the configured widgets (and by the widgets that
+ * can automatically replace them), and frees the ones that aren't needed
+ */
+void SidebarWidgets_updateLoadedIcons();
 void SidebarWidgets_updateTime(struct tm* timeInfo);
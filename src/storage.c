@@ -0,0 +1,146 @@
+#include <pebble.h>
+#include "storage.h"
+#include "replay.h"
+
+typedef struct {
+  uint32_t key;
+  uint8_t* shadow; // the bytes that are (or will be, once flushed) in flash
+  uint16_t size;
+  bool isInt;
+  bool dirty;
+} StorageEntry;
+
+StorageEntry Storage_entries[STORAGE_MAX_KEYS];
+int Storage_entryCount = 0;
+
+AppTimer* Storage_writeTimer = NULL;
+
+void writeTimerCallback(void* context);
+
+/*
+ * Finds the entry for the key, creating it (and filling its shadow with
+ * what's currently in flash) if needed. Returns NULL if there's no room
+ */
+StorageEntry* getEntry(uint32_t key, size_t size, bool isInt) {
+  for(int i = 0; i < Storage_entryCount; i++) {
+    if(Storage_entries[i].key == key) {
+      return (Storage_entries[i].size == size) ? &Storage_entries[i] : NULL;
+    }
+  }
+
+  if(Storage_entryCount >= STORAGE_MAX_KEYS) {
+    return NULL;
+  }
+
+  uint8_t* shadow = malloc(size);
+
+  if(!shadow) {
+    return NULL;
+  }
+
+  memset(shadow, 0, size);
+
+  StorageEntry* entry = &Storage_entries[Storage_entryCount++];
+  entry->key = key;
+  entry->shadow = shadow;
+  entry->size = size;
+  entry->isInt = isInt;
+
+  // if there's nothing matching in flash, make sure the first write happens
+  entry->dirty = !persist_exists(key);
+
+  if(!entry->dirty) {
+    if(isInt) {
+      int32_t value = persist_read_int(key);
+      memcpy(shadow, &value, sizeof(int32_t));
+    } else if(persist_get_size(key) == (int)size) {
+      persist_read_data(key, shadow, size);
+    } else {
+      entry->dirty = true;
+    }
+  }
+
+  return entry;
+}
+
+void scheduleWrite() {
+  if(Storage_writeTimer) {
+    app_timer_reschedule(Storage_writeTimer, STORAGE_WRITE_DELAY_MS);
+  } else {
+    Storage_writeTimer = app_timer_register(STORAGE_WRITE_DELAY_MS, writeTimerCallback, NULL);
+  }
+}
+
+void storeEntry(uint32_t key, const void* data, size_t size, bool isInt) {
+  StorageEntry* entry = getEntry(key, size, isInt);
+
+  if(!entry) {
+    // no shadow copy for this one, so just write it
+    if(isInt) {
+      persist_write_int(key, *(const int32_t*)data);
+    } else {
+      persist_write_data(key, data, size);
+    }
+
+    return;
+  }
+
+  // nothing changed, nothing to write
+  if(!entry->dirty && memcmp(entry->shadow, data, size) == 0) {
+    return;
+  }
+
+  memcpy(entry->shadow, data, size);
+  entry->dirty = true;
+
+  scheduleWrite();
+}
+
+void Storage_writeData(uint32_t key, const void* data, size_t size) {
+  storeEntry(key, data, size, false);
+}
+
+void Storage_writeInt(uint32_t key, int32_t value) {
+  storeEntry(key, &value, sizeof(int32_t), true);
+}
+
+void Storage_flush() {
+  if(Storage_writeTimer) {
+    app_timer_cancel(Storage_writeTimer);
+    Storage_writeTimer = NULL;
+  }
+
+  for(int i = 0; i < Storage_entryCount; i++) {
+    StorageEntry* entry = &Storage_entries[i];
+
+    if(entry->dirty) {
+      if(entry->isInt) {
+        int32_t value;
+        memcpy(&value, entry->shadow, sizeof(int32_t));
+        persist_write_int(entry->key, value);
+      } else {
+        persist_write_data(entry->key, entry->shadow, entry->size);
+      }
+
+      entry->dirty = false;
+    }
+  }
+}
+
+void writeTimerCallback(void* context) {
+  // the timer is done, so make sure flush doesn't try to cancel it
+  Storage_writeTimer = NULL;
+
+  Storage_flush();
+}
+
+void Storage_deinit() {
+  Storage_flush();
+
+  for(int i = 0; i < Storage_entryCount; i++) {
+    free(Storage_entries[i].shadow);
+    Storage_entries[i].shadow = NULL;
+  }
+
+  Storage_entryCount = 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <pebble.h>
+
+/*
+ * Coalesces persistent storage writes. Each key keeps a shadow copy of
+ * what's in flash, so writing identical bytes does nothing, and changed keys
+ * are written together once STORAGE_WRITE_DELAY_MS has passed without
+ * another write, so a burst of messages only touches flash once.
+ */
+
+#define STORAGE_WRITE_DELAY_MS 2000
+
+// the number of keys with shadow copies. Any more are written straight through
+#define STORAGE_MAX_KEYS 6
+
+void Storage_writeData(uint32_t key, const void* data, size_t size);
+void Storage_writeInt(uint32_t key, int32_t value);
+
+/*
+ * Writes any pending changes to flash immediately
+ */
+void Storage_flush();
+
+/*
+ * Flushes, then frees the shadow copies
+ */
+void Storage_deinit();
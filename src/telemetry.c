@@ -0,0 +1,198 @@
+#include <pebble.h>
+#include "messaging.h"
+#include "util.h"
+#include "telemetry.h"
+
+// only the counters, telemetry keeps measuring in real time
+#define REPLAY_NO_WRAP
+#include "replay.h"
+
+// the finished samples, oldest at Telemetry_nextSample once the buffer is full
+TelemetrySample Telemetry_samples[TELEMETRY_SAMPLE_COUNT];
+int Telemetry_nextSample = 0;
+int Telemetry_sampleCount = 0;
+
+TelemetrySample Telemetry_current;
+
+uint32_t Telemetry_tickStartTime;
+uint32_t Telemetry_layerStartTimes[TELEMETRY_LAYER_COUNT];
+
+// the index of the next sample to send, or -1 if we're not dumping
+int Telemetry_dumpIndex = -1;
+
+void resetCurrentSample() {
+  memset(&Telemetry_current, 0, sizeof(TelemetrySample));
+
+  Telemetry_current.timestamp = time(NULL);
+
+  size_t heapFree = heap_bytes_free();
+  Telemetry_current.heapLowWater = (heapFree > UINT16_MAX) ? UINT16_MAX : heapFree;
+}
+
+void updateHeapLowWater() {
+  size_t heapFree = heap_bytes_free();
+
+  if(heapFree < Telemetry_current.heapLowWater) {
+    Telemetry_current.heapLowWater = heapFree;
+  }
+}
+
+// the counters saturate instead of wrapping around
+void addSaturated16(uint16_t* counter, uint32_t amount) {
+  *counter = (*counter + amount > UINT16_MAX) ? UINT16_MAX : *counter + amount;
+}
+
+void addSaturated32(uint32_t* counter, uint32_t amount) {
+  *counter = (*counter > UINT32_MAX - amount) ? UINT32_MAX : *counter + amount;
+}
+
+void addSaturated8(uint8_t* counter) {
+  if(*counter < UINT8_MAX) {
+    (*counter)++;
+  }
+}
+
+void updateMax16(uint16_t* max, uint32_t value) {
+  if(value > *max) {
+    *max = (value > UINT16_MAX) ? UINT16_MAX : value;
+  }
+}
+
+void Telemetry_init() {
+  Telemetry_nextSample = 0;
+  Telemetry_sampleCount = 0;
+  Telemetry_dumpIndex = -1;
+
+  resetCurrentSample();
+}
+
+void Telemetry_tickStarted(struct tm* tickTime) {
+  time_t seconds;
+  uint16_t milliseconds;
+
+  time_ms(&seconds, &milliseconds);
+  Telemetry_tickStartTime = (uint32_t)seconds * 1000 + milliseconds;
+
+  // the tick is due at the start of its second. Time zones are whole minutes,
+  // so the UTC seconds can be compared with the local ones
+  int secondsLate = ((int)(seconds % 60) - tickTime->tm_sec + 60) % 60;
+  uint32_t latency = secondsLate * 1000 + milliseconds;
+
+  addSaturated16(&Telemetry_current.ticks, 1);
+  updateMax16(&Telemetry_current.tickLatencyMaxMs, latency);
+  addSaturated32(&Telemetry_current.tickLatencyTotalMs, latency);
+}
+
+void Telemetry_tickFinished() {
+  uint32_t now = time_get_ms();
+
+  updateMax16(&Telemetry_current.tickDurationMaxMs, now - Telemetry_tickStartTime);
+  updateHeapLowWater();
+
+  // is it time to start a new sample? The millisecond counter wraps, so this
+  // needs the real time
+  if((uint32_t)time(NULL) - Telemetry_current.timestamp >= TELEMETRY_SAMPLE_MINUTES * 60) {
+    Telemetry_samples[Telemetry_nextSample] = Telemetry_current;
+    Telemetry_nextSample = (Telemetry_nextSample + 1) % TELEMETRY_SAMPLE_COUNT;
+
+    if(Telemetry_sampleCount < TELEMETRY_SAMPLE_COUNT) {
+      Telemetry_sampleCount++;
+    }
+
+    resetCurrentSample();
+  }
+}
+
+void Telemetry_layerUpdateStarted(TelemetryLayer layer) {
+  Telemetry_layerStartTimes[layer] = time_get_ms();
+}
+
+void Telemetry_layerUpdateFinished(TelemetryLayer layer) {
+  uint32_t duration = time_get_ms() - Telemetry_layerStartTimes[layer];
+
+  addSaturated16(&Telemetry_current.layerUpdates[layer], 1);
+  updateMax16(&Telemetry_current.layerUpdateMaxMs[layer], duration);
+  addSaturated32(&Telemetry_current.layerUpdateTotalMs[layer], duration);
+  updateHeapLowWater();
+
+  #ifdef TIMESTYLE_REPLAY
+    Replay_count(REPLAY_COUNTER_REDRAWS);
+  #endif
+}
+
+void Telemetry_countResourceLoad() {
+  addSaturated16(&Telemetry_current.resourceLoads, 1);
+  updateHeapLowWater();
+
+  #ifdef TIMESTYLE_REPLAY
+    Replay_count(REPLAY_COUNTER_RESOURCE_LOADS);
+  #endif
+}
+
+void Telemetry_countMessage(TelemetryMessageEvent event) {
+  switch(event) {
+    case TELEMETRY_INBOX_RECEIVED:
+      addSaturated8(&Telemetry_current.inboxReceived);
+      break;
+    case TELEMETRY_INBOX_DROPPED:
+      addSaturated8(&Telemetry_current.inboxDropped);
+      break;
+    case TELEMETRY_OUTBOX_SENT:
+      addSaturated8(&Telemetry_current.outboxSent);
+      break;
+    case TELEMETRY_OUTBOX_FAILED:
+      addSaturated8(&Telemetry_current.outboxFailed);
+      break;
+  }
+}
+
+void Telemetry_startDump() {
+  Telemetry_dumpIndex = 0;
+
+  if(!Telemetry_continueDump()) {
+    // the outbox is busy, give up rather than getting out of step
+    Telemetry_cancelDump();
+  }
+}
+
+bool Telemetry_continueDump() {
+  if(Telemetry_dumpIndex < 0) {
+    return false;
+  }
+
+  // the finished samples first, then the one in progress
+  int total = Telemetry_sampleCount + 1;
+
+  if(Telemetry_dumpIndex >= total) {
+    Telemetry_dumpIndex = -1;
+    return false;
+  }
+
+  TelemetrySample* sample;
+
+  if(Telemetry_dumpIndex < Telemetry_sampleCount) {
+    int oldest = (Telemetry_nextSample - Telemetry_sampleCount + TELEMETRY_SAMPLE_COUNT) % TELEMETRY_SAMPLE_COUNT;
+    sample = &Telemetry_samples[(oldest + Telemetry_dumpIndex) % TELEMETRY_SAMPLE_COUNT];
+  } else {
+    sample = &Telemetry_current;
+  }
+
+  DictionaryIterator *iter;
+
+  if(app_message_outbox_begin(&iter) != APP_MSG_OK) {
+    return false;
+  }
+
+  dict_write_data(iter, KEY_TELEMETRY_DATA, (const uint8_t*)sample, sizeof(TelemetrySample));
+  dict_write_uint8(iter, KEY_TELEMETRY_INDEX, Telemetry_dumpIndex);
+  dict_write_uint8(iter, KEY_TELEMETRY_COUNT, total);
+  app_message_outbox_send();
+
+  Telemetry_dumpIndex++;
+
+  return true;
+}
+
+void Telemetry_cancelDump() {
+  Telemetry_dumpIndex = -1;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <pebble.h>
+
+/*
+ * Field telemetry. Counters accumulate into the current sample, which is
+ * pushed into a small ring buffer every TELEMETRY_SAMPLE_MINUTES minutes.
+ * The phone can ask for the whole buffer by sending KEY_TELEMETRY_DUMP
+ */
+
+#define TELEMETRY_SAMPLE_MINUTES 15
+
+#ifdef PBL_PLATFORM_APLITE
+  #define TELEMETRY_SAMPLE_COUNT 8
+#else
+  #define TELEMETRY_SAMPLE_COUNT 16
+#endif
+
+typedef enum {
+  TELEMETRY_LAYER_SIDEBAR,
+  TELEMETRY_LAYER_SIDEBAR_RIGHT, // only used by the round sidebar
+  TELEMETRY_LAYER_COUNT
+} TelemetryLayer;
+
+typedef enum {
+  TELEMETRY_INBOX_RECEIVED,
+  TELEMETRY_INBOX_DROPPED,
+  TELEMETRY_OUTBOX_SENT,
+  TELEMETRY_OUTBOX_FAILED
+} TelemetryMessageEvent;
+
+/*
+ * One sample period. This is sent to the phone as-is, so the layout must
+ * match the decoder in app.js (little endian, no padding between fields)
+ */
+typedef struct {
+  uint32_t timestamp;           // start of the period, in seconds since the epoch
+  uint32_t tickLatencyTotalMs;
+  uint32_t layerUpdateTotalMs[TELEMETRY_LAYER_COUNT];
+  uint16_t heapLowWater;        // lowest heap_bytes_free() seen
+  uint16_t resourceLoads;
+  uint16_t ticks;
+  uint16_t tickLatencyMaxMs;    // from the start of the second to the tick handler
+  uint16_t tickDurationMaxMs;
+  uint16_t layerUpdates[TELEMETRY_LAYER_COUNT];
+  uint16_t layerUpdateMaxMs[TELEMETRY_LAYER_COUNT];
+  uint8_t inboxReceived;
+  uint8_t inboxDropped;
+  uint8_t outboxSent;
+  uint8_t outboxFailed;
+  uint8_t reserved[2];          // keeps the size a multiple of 4
+} TelemetrySample;
+
+void Telemetry_init();
+
+/*
+ * Call at the start and end of the tick handler
+ */
+void Telemetry_tickStarted(struct tm* tickTime);
+void Telemetry_tickFinished();
+
+/*
+ * Call at the start and end of a layer's update_proc
+ */
+void Telemetry_layerUpdateStarted(TelemetryLayer layer);
+void Telemetry_layerUpdateFinished(TelemetryLayer layer);
+
+void Telemetry_countResourceLoad();
+void Telemetry_countMessage(TelemetryMessageEvent event);
+
+/*
+ * Starts sending the recorded samples to the phone, one per message, oldest
+ * first and ending with the sample in progress
+ */
+void Telemetry_startDump();
+
+/*
+ * Sends the next sample of a dump in progress. Call when the previous
+ * message was delivered; returns false once there's nothing left to send
+ */
+bool Telemetry_continueDump();
+void Telemetry_cancelDump();
@@ -0,0 +1,88 @@
+#include <pebble.h>
+#include "settings.h"
+#include "sidebar.h"
+#include "util.h"
+#include "tick_scheduler.h"
+#include "replay.h"
+
+TickHandler TickScheduler_handler;
+
+// the unit we're currently subscribed with, or 0 if not subscribed
+TimeUnits TickScheduler_currentUnit = 0;
+
+// while something else covers the watchface, nobody can see the seconds
+bool TickScheduler_focused = true;
+
+#ifdef PBL_HEALTH
+  void TickScheduler_healthHandler(HealthEventType event, void *context);
+#endif
+
+TimeUnits getNeededTickUnit() {
+  if(!TickScheduler_focused) {
+    return MINUTE_UNIT;
+  }
+
+  #ifdef PBL_HEALTH
+    // don't bother ticking the seconds while the user is asleep
+    if(is_user_sleeping()) {
+      return MINUTE_UNIT;
+    }
+  #endif
+
+  if(Sidebar_getVisibleInputs() & WIDGET_INPUT_SECONDS) {
+    return SECOND_UNIT;
+  }
+
+  return MINUTE_UNIT;
+}
+
+void TickScheduler_init(TickHandler handler) {
+  TickScheduler_handler = handler;
+  TickScheduler_currentUnit = 0;
+
+  TickScheduler_update();
+
+  #ifdef PBL_HEALTH
+    // falling asleep or waking up changes the tick rate
+    health_service_events_subscribe(TickScheduler_healthHandler, NULL);
+  #endif
+}
+
+void TickScheduler_deinit() {
+  #ifdef PBL_HEALTH
+    health_service_events_unsubscribe();
+  #endif
+
+  tick_timer_service_unsubscribe();
+  TickScheduler_currentUnit = 0;
+}
+
+void TickScheduler_update() {
+  // not started yet
+  if(!TickScheduler_handler) {
+    return;
+  }
+
+  TimeUnits neededUnit = getNeededTickUnit();
+
+  if(neededUnit != TickScheduler_currentUnit) {
+    tick_timer_service_unsubscribe();
+    tick_timer_service_subscribe(neededUnit, TickScheduler_handler);
+
+    TickScheduler_currentUnit = neededUnit;
+  }
+}
+
+void TickScheduler_setFocused(bool focused) {
+  TickScheduler_focused = focused;
+
+  TickScheduler_update();
+}
+
+#ifdef PBL_HEALTH
+  void TickScheduler_healthHandler(HealthEventType event, void *context) {
+    if(event == HealthEventSleepUpdate || event == HealthEventSignificantUpdate) {
+      TickScheduler_update();
+    }
+  }
+#endif
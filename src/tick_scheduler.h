@@ -0,0 +1,18 @@
+#pragma once
+#include <pebble.h>
+
+/*
+ * Keeps the tick timer subscription at the coarsest unit the watchface needs
+ * right now: seconds only while the seconds widget is actually on screen and
+ * the watchface has focus, minutes otherwise
+ */
+void TickScheduler_init(TickHandler handler);
+void TickScheduler_deinit();
+
+/*
+ * Re-evaluates the tick rate. Call this whenever something that affects which
+ * widgets are shown (settings, battery, bluetooth) changes
+ */
+void TickScheduler_update();
+
+void TickScheduler_setFocused(bool focused);
@@ -20,17 +20,103 @@ void gdraw_command_image_recolor(GDrawCommandImage *img, GColor fill_color, GCol
                              recolor_iterator_cb, &colors);
 }
 
-int time_get_beats(const struct tm *tm) {
-  // code from https://gist.github.com/insom/bf40b91fd25ae1d84764
+int time_get_beats(time_t utcTime) {
+  // add an hour to make it into BMT, then count the 86.4 second beats
+  int secondsToday = (utcTime + 3600) % 86400;
 
-  time_t t = mktime((struct tm *)tm);
-  t = t + 3600; // Add an hour to make into BMT
+  return secondsToday * 10 / 864;
+}
+
+/*
+ * Returns the day of the week (0 = sunday) that Dec 31st of the specified
+ * year falls on
+ */
+int dec31_weekday(int year) {
+  return (year + year / 4 - year / 100 + year / 400) % 7;
+}
+
+int iso_weeks_in_year(int year) {
+  // a year has 53 weeks if it starts or ends on a thursday
+  if(dec31_weekday(year) == 4 || dec31_weekday(year - 1) == 3) {
+    return 53;
+  } else {
+    return 52;
+  }
+}
+
+int time_get_iso_week(const struct tm *tm) {
+  int year = tm->tm_year + 1900;
+  int weekday = (tm->tm_wday + 6) % 7; // monday = 0
+
+  int week = (tm->tm_yday - weekday + 10) / 7;
+
+  if(week < 1) {
+    // the last week of the previous year
+    week = iso_weeks_in_year(year - 1);
+  } else if(week > iso_weeks_in_year(year)) {
+    // the first week of next year
+    week = 1;
+  }
+
+  return week;
+}
+
+int int_to_str(char *buffer, size_t size, int value, int minDigits) {
+  char digits[12];
+  int digitCount = 0;
+  bool negative = value < 0;
+  unsigned int remaining = negative ? -(unsigned int)value : (unsigned int)value;
+
+  // generate the digits, least significant first
+  do {
+    digits[digitCount++] = '0' + remaining % 10;
+    remaining /= 10;
+  } while(remaining > 0);
+
+  while(digitCount < minDigits && digitCount < (int)sizeof(digits)) {
+    digits[digitCount++] = '0';
+  }
+
+  int length = 0;
+
+  if(negative && length < (int)size - 1) {
+    buffer[length++] = '-';
+  }
+
+  while(digitCount > 0 && length < (int)size - 1) {
+    buffer[length++] = digits[--digitCount];
+  }
+
+  buffer[length] = '\0';
+
+  return length;
+}
+
+int append_str(char *buffer, size_t size, int length, const char *text) {
+  while(*text != '\0' && length < (int)size - 1) {
+    buffer[length++] = *text++;
+  }
+
+  buffer[length] = '\0';
+
+  return length;
+}
+
+int format_int(char *buffer, size_t size, const char *prefix, int value, const char *suffix) {
+  int length = append_str(buffer, size, 0, prefix);
+
+  length += int_to_str(buffer + length, size - length, value, 1);
+
+  return append_str(buffer, size, length, suffix);
+}
+
+uint32_t time_get_ms() {
+  time_t seconds;
+  uint16_t milliseconds;
 
-  struct tm *bt = gmtime(&t);
-  double sex = (bt->tm_hour * 3600) + (bt->tm_min * 60) + bt->tm_sec;
-  int beats = (int)(10 * (sex / 864)) % 1000;
+  time_ms(&seconds, &milliseconds);
 
-  return beats;
+  return (uint32_t)seconds * 1000 + milliseconds;
 }
 
 #ifdef PBL_HEALTH
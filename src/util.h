@@ -10,9 +10,44 @@
 extern void gdraw_command_image_recolor(GDrawCommandImage *img, GColor fill_color, GColor stroke_color);
 
 /*
- * Returns the current time in Swatch Internet Time "beats"
+ * Log messages less severe than this are compiled out of the binary. Override
+ * it at build time to get the debug messages back
  */
-extern int time_get_beats(const struct tm *tm);
+#ifndef TIMESTYLE_LOG_LEVEL
+  #define TIMESTYLE_LOG_LEVEL APP_LOG_LEVEL_WARNING
+#endif
+
+#define LOG(level, ...) \
+  do { if((level) <= TIMESTYLE_LOG_LEVEL) { APP_LOG((level), __VA_ARGS__); } } while(0)
+
+/*
+ * Returns the specified UTC time in Swatch Internet Time "beats"
+ */
+extern int time_get_beats(time_t utcTime);
+
+/*
+ * Returns the ISO 8601 week number of the specified date (same as %V)
+ */
+extern int time_get_iso_week(const struct tm *tm);
+
+/*
+ * Writes value to buffer in decimal, zero-padded to at least minDigits,
+ * without going through the libc formatting code. Returns the number of
+ * characters written, not counting the terminating null
+ */
+extern int int_to_str(char *buffer, size_t size, int value, int minDigits);
+
+/*
+ * Like int_to_str, with prefix before the value and suffix after it (either
+ * can be ""), for the "%d°" style strings the widgets draw. Returns the number
+ * of characters written, not counting the terminating null
+ */
+extern int format_int(char *buffer, size_t size, const char *prefix, int value, const char *suffix);
+
+/*
+ * Returns a millisecond timestamp, for measuring short durations
+ */
+extern uint32_t time_get_ms();
 
 #ifdef PBL_HEALTH
   /*
@@ -1,78 +1,327 @@
 #include <pebble.h>
 #include "weather.h"
+#include "settings.h"
+#include "util.h"
+#include "telemetry.h"
+#include "storage.h"
+#include "replay.h"
 
 WeatherInfo Weather_weatherInfo;
 WeatherForecastInfo Weather_weatherForecast;
+WeatherHourlyForecast Weather_hourlyForecast;
 
 GDrawCommandImage* Weather_currentWeatherIcon;
 GDrawCommandImage* Weather_forecastWeatherIcon;
 
-uint32_t getConditionIcon(WeatherCondition conditionCode) {
-  uint32_t iconToLoad;
-
-  switch(conditionCode) {
-    case CLEAR_DAY:
-      iconToLoad = RESOURCE_ID_WEATHER_CLEAR_DAY;
-      break;
-    case CLEAR_NIGHT:
-      iconToLoad = RESOURCE_ID_WEATHER_CLEAR_NIGHT;
-      break;
-    case CLOUDY_DAY:
-      iconToLoad = RESOURCE_ID_WEATHER_CLOUDY;
-      break;
-    case HEAVY_RAIN:
-      iconToLoad = RESOURCE_ID_WEATHER_HEAVY_RAIN;
-      break;
-    case HEAVY_SNOW:
-      iconToLoad = RESOURCE_ID_WEATHER_HEAVY_SNOW;
-      break;
-    case LIGHT_RAIN:
-      iconToLoad = RESOURCE_ID_WEATHER_LIGHT_RAIN;
-      break;
-    case LIGHT_SNOW:
-      iconToLoad = RESOURCE_ID_WEATHER_LIGHT_SNOW;
-      break;
-    case PARTLY_CLOUDY_NIGHT:
-      iconToLoad = RESOURCE_ID_WEATHER_PARTLY_CLOUDY_NIGHT;
-      break;
-    case PARTLY_CLOUDY:
-      iconToLoad = RESOURCE_ID_WEATHER_PARTLY_CLOUDY;
-      break;
-    case RAINING_AND_SNOWING:
-      iconToLoad = RESOURCE_ID_WEATHER_RAINING_AND_SNOWING;
-      break;
-    case THUNDERSTORM:
-      iconToLoad = RESOURCE_ID_WEATHER_THUNDERSTORM;
-      break;
-    default:
-      iconToLoad = RESOURCE_ID_WEATHER_GENERIC;
-      break;
-  }
-
-  return iconToLoad;
+// the colors the weather icons are currently tinted with
+GColor Weather_tintedFillColor;
+GColor Weather_tintedStrokeColor;
+
+// whether the sidebar shows each icon, and so whether it should be loaded
+bool Weather_currentIconEnabled = false;
+bool Weather_forecastIconEnabled = false;
+
+// the resource for each WeatherCondition
+const uint32_t Weather_conditionIcons[WEATHER_GENERIC + 1] = {
+  [CLEAR_DAY]           = RESOURCE_ID_WEATHER_CLEAR_DAY,
+  [CLEAR_NIGHT]         = RESOURCE_ID_WEATHER_CLEAR_NIGHT,
+  [CLOUDY_DAY]          = RESOURCE_ID_WEATHER_CLOUDY,
+  [HEAVY_RAIN]          = RESOURCE_ID_WEATHER_HEAVY_RAIN,
+  [HEAVY_SNOW]          = RESOURCE_ID_WEATHER_HEAVY_SNOW,
+  [LIGHT_RAIN]          = RESOURCE_ID_WEATHER_LIGHT_RAIN,
+  [LIGHT_SNOW]          = RESOURCE_ID_WEATHER_LIGHT_SNOW,
+  [PARTLY_CLOUDY_NIGHT] = RESOURCE_ID_WEATHER_PARTLY_CLOUDY_NIGHT,
+  [PARTLY_CLOUDY]       = RESOURCE_ID_WEATHER_PARTLY_CLOUDY,
+  [RAINING_AND_SNOWING] = RESOURCE_ID_WEATHER_RAINING_AND_SNOWING,
+  [THUNDERSTORM]        = RESOURCE_ID_WEATHER_THUNDERSTORM,
+  [WEATHER_GENERIC]     = RESOURCE_ID_WEATHER_GENERIC
+};
+
+WeatherIconCacheEntry Weather_iconCache[WEATHER_ICON_CACHE_SIZE];
+
+void tintIcon(GDrawCommandImage* icon) {
+  if(icon) {
+    gdraw_command_image_recolor(icon, Weather_tintedFillColor, Weather_tintedStrokeColor);
+  }
 }
 
-void Weather_setCurrentCondition(int conditionCode) {
+uint32_t getConditionIcon(int conditionCode) {
+  if(conditionCode < 0 || conditionCode > WEATHER_GENERIC) {
+    return RESOURCE_ID_WEATHER_GENERIC;
+  }
+
+  return Weather_conditionIcons[conditionCode];
+}
+
+/*
+ * Returns the icon for the resource, sharing it if it's already loaded.
+ * Each acquired icon must be released again
+ */
+GDrawCommandImage* acquireIcon(uint32_t resourceId) {
+  WeatherIconCacheEntry* freeEntry = NULL;
+
+  for(int i = 0; i < WEATHER_ICON_CACHE_SIZE; i++) {
+    WeatherIconCacheEntry* entry = &Weather_iconCache[i];
+
+    if(entry->refCount > 0 && entry->resourceId == resourceId) {
+      entry->refCount++;
+      return entry->image;
+    }
+
+    if(entry->refCount == 0 && !freeEntry) {
+      freeEntry = entry;
+    }
+  }
 
-  uint32_t currentWeatherIcon = getConditionIcon(conditionCode);
+  // there's an entry for each icon user, and updateIcon releases before it
+  // acquires, so this shouldn't happen
+  if(!freeEntry) {
+    return NULL;
+  }
+
+  freeEntry->image = gdraw_command_image_create_with_resource(resourceId);
+  Telemetry_countResourceLoad();
+
+  if(!freeEntry->image) {
+    return NULL;
+  }
+
+  freeEntry->resourceId = resourceId;
+  freeEntry->refCount = 1;
+  tintIcon(freeEntry->image);
+
+  return freeEntry->image;
+}
 
-  // ok, now load the new icon:
-  gdraw_command_image_destroy(Weather_currentWeatherIcon);
-  Weather_currentWeatherIcon = gdraw_command_image_create_with_resource(currentWeatherIcon);
+void releaseIcon(GDrawCommandImage* image) {
+  if(!image) {
+    return;
+  }
+
+  for(int i = 0; i < WEATHER_ICON_CACHE_SIZE; i++) {
+    WeatherIconCacheEntry* entry = &Weather_iconCache[i];
+
+    if(entry->refCount > 0 && entry->image == image) {
+      entry->refCount--;
+
+      if(entry->refCount == 0) {
+        gdraw_command_image_destroy(entry->image);
+        entry->image = NULL;
+      }
 
-  Weather_weatherInfo.currentIconResourceID = currentWeatherIcon;
+      return;
+    }
+  }
+}
+
+// returns the resource ID of a loaded icon, or 0 if it isn't in the cache
+uint32_t getIconResource(GDrawCommandImage* image) {
+  for(int i = 0; i < WEATHER_ICON_CACHE_SIZE; i++) {
+    WeatherIconCacheEntry* entry = &Weather_iconCache[i];
+
+    if(entry->refCount > 0 && entry->image == image) {
+      return entry->resourceId;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Makes sure the icon is the one for the given resource if it's enabled,
+ * or released if it isn't. An unchanged icon is kept as it is, and a changed
+ * one is released first, so that its cache entry can be reused
+ */
+void updateIcon(GDrawCommandImage** icon, uint32_t resourceID, bool enabled) {
+  bool wanted = enabled && resourceID != 0;
+
+  if(wanted && *icon && getIconResource(*icon) == resourceID) {
+    return;
+  }
+
+  releaseIcon(*icon);
+  *icon = NULL;
+
+  if(wanted) {
+    *icon = acquireIcon(resourceID);
+  }
+}
+
+void Weather_setCurrentCondition(int conditionCode) {
+  Weather_weatherInfo.currentIconResourceID = getConditionIcon(conditionCode);
+
+  updateIcon(&Weather_currentWeatherIcon, Weather_weatherInfo.currentIconResourceID, Weather_currentIconEnabled);
 }
 
 void Weather_setForecastCondition(int conditionCode) {
-  uint32_t forecastWeatherIcon = getConditionIcon(conditionCode);
+  Weather_weatherForecast.forecastIconResourceID = getConditionIcon(conditionCode);
+
+  updateIcon(&Weather_forecastWeatherIcon, Weather_weatherForecast.forecastIconResourceID, Weather_forecastIconEnabled);
+}
+
+/*
+ * Shows the current point of the hourly forecast as the current conditions,
+ * and summarizes the next 24 hours as today's forecast
+ */
+void applyHourlyForecast() {
+  WeatherHourlyForecast* forecast = &Weather_hourlyForecast;
+
+  if(forecast->count == 0) {
+    return;
+  }
+
+  WeatherForecastPoint* current = &forecast->points[forecast->head];
+
+  Weather_weatherInfo.currentTemp = current->temp;
+  Weather_setCurrentCondition(current->condition);
+
+  int pointsPerDay = (24 * 60 + forecast->intervalMinutes - 1) / forecast->intervalMinutes;
+  int pointCount = (forecast->count < pointsPerDay) ? forecast->count : pointsPerDay;
+
+  int highTemp = INT8_MIN;
+  int lowTemp = INT8_MAX;
+
+  // we can't average conditions, so use the most common one
+  uint8_t conditionCounts[WEATHER_GENERIC + 1] = {0};
+  uint8_t forecastCondition = current->condition;
+  uint8_t forecastConditionCount = 0;
+
+  for(int i = 0; i < pointCount; i++) {
+    WeatherForecastPoint* point = &forecast->points[(forecast->head + i) % WEATHER_HOURLY_POINTS];
+
+    if(point->temp > highTemp) {
+      highTemp = point->temp;
+    }
+
+    if(point->temp < lowTemp) {
+      lowTemp = point->temp;
+    }
 
-  gdraw_command_image_destroy(Weather_forecastWeatherIcon);
-  Weather_forecastWeatherIcon = gdraw_command_image_create_with_resource(forecastWeatherIcon);
+    if(point->condition <= WEATHER_GENERIC) {
+      conditionCounts[point->condition]++;
 
-  Weather_weatherForecast.forecastIconResourceID = forecastWeatherIcon;
+      if(conditionCounts[point->condition] > forecastConditionCount) {
+        forecastCondition = point->condition;
+        forecastConditionCount = conditionCounts[point->condition];
+      }
+    }
+  }
+
+  Weather_weatherForecast.highTemp = highTemp;
+  Weather_weatherForecast.lowTemp = lowTemp;
+  Weather_setForecastCondition(forecastCondition);
+}
+
+void Weather_setHourlyForecast(const uint8_t* data, uint16_t length) {
+  if(length < 7) {
+    return;
+  }
+
+  uint16_t intervalMinutes = data[4] | (data[5] << 8);
+  uint8_t count = data[6];
+
+  // keep as many points as we have room for
+  if(count > WEATHER_HOURLY_POINTS) {
+    count = WEATHER_HOURLY_POINTS;
+  }
+
+  if(intervalMinutes == 0 || length < 7 + count * 2) {
+    return;
+  }
+
+  WeatherHourlyForecast* forecast = &Weather_hourlyForecast;
+
+  forecast->startTime = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+  forecast->intervalMinutes = intervalMinutes;
+  forecast->head = 0;
+  forecast->count = count;
+
+  for(int i = 0; i < count; i++) {
+    forecast->points[i].temp = (int8_t)data[7 + i * 2];
+    forecast->points[i].condition = data[8 + i * 2];
+  }
+
+  // skip any points that are already in the past, then show the rest
+  Weather_advanceHourlyForecast(time(NULL));
+  applyHourlyForecast();
+}
+
+void Weather_clearHourlyForecast() {
+  Weather_hourlyForecast.head = 0;
+  Weather_hourlyForecast.count = 0;
+}
+
+bool Weather_advanceHourlyForecast(time_t now) {
+  WeatherHourlyForecast* forecast = &Weather_hourlyForecast;
+
+  if(forecast->count == 0 || forecast->intervalMinutes == 0) {
+    return false;
+  }
+
+  uint32_t interval = forecast->intervalMinutes * 60;
+  bool advanced = false;
+
+  // just move the head, the points themselves stay put
+  while(forecast->count > 1 && (uint32_t)now >= forecast->startTime + interval) {
+    forecast->head = (forecast->head + 1) % WEATHER_HOURLY_POINTS;
+    forecast->count--;
+    forecast->startTime += interval;
+    advanced = true;
+  }
+
+  if(advanced) {
+    applyHourlyForecast();
+  }
+
+  return advanced;
+}
+
+bool Weather_needsRefresh(time_t now) {
+  WeatherHourlyForecast* forecast = &Weather_hourlyForecast;
+
+  if(forecast->count == 0 || forecast->intervalMinutes == 0) {
+    return true;
+  }
+
+  uint32_t forecastEnd = forecast->startTime + forecast->count * forecast->intervalMinutes * 60;
+
+  return forecastEnd < (uint32_t)now + WEATHER_HOURLY_MIN_COVERAGE_HOURS * 60 * 60;
+}
+
+void Weather_setIconsEnabled(bool currentIcon, bool forecastIcon) {
+  // only touch the icons whose state actually changed
+  if(currentIcon != Weather_currentIconEnabled) {
+    Weather_currentIconEnabled = currentIcon;
+    updateIcon(&Weather_currentWeatherIcon, Weather_weatherInfo.currentIconResourceID, currentIcon);
+  }
+
+  if(forecastIcon != Weather_forecastIconEnabled) {
+    Weather_forecastIconEnabled = forecastIcon;
+    updateIcon(&Weather_forecastWeatherIcon, Weather_weatherForecast.forecastIconResourceID, forecastIcon);
+  }
+}
+
+void Weather_updateIconColors() {
+  if(gcolor_equal(Weather_tintedFillColor, globalSettings.iconFillColor) &&
+     gcolor_equal(Weather_tintedStrokeColor, globalSettings.iconStrokeColor)) {
+    return;
+  }
+
+  Weather_tintedFillColor = globalSettings.iconFillColor;
+  Weather_tintedStrokeColor = globalSettings.iconStrokeColor;
+
+  for(int i = 0; i < WEATHER_ICON_CACHE_SIZE; i++) {
+    if(Weather_iconCache[i].refCount > 0) {
+      tintIcon(Weather_iconCache[i].image);
+    }
+  }
 }
 
 void Weather_init() {
+  // icons get tinted as they're loaded
+  Weather_tintedFillColor = globalSettings.iconFillColor;
+  Weather_tintedStrokeColor = globalSettings.iconStrokeColor;
+
   // if possible, load weather data from persistent storage
   if (persist_exists(WEATHERINFO_PERSIST_KEY)) {
     // printf("current key exists!");
@@ -80,15 +329,12 @@ void Weather_init() {
     persist_read_data(WEATHERINFO_PERSIST_KEY, &w, sizeof(WeatherInfo));
 
     Weather_weatherInfo = w;
-
-    Weather_currentWeatherIcon = gdraw_command_image_create_with_resource(w.currentIconResourceID);
-
   } else {
 
     // printf("current key does not exist!");
     // otherwise, use null data
-    Weather_currentWeatherIcon = NULL;
     Weather_weatherInfo.currentTemp = INT32_MIN;
+    Weather_weatherInfo.currentIconResourceID = 0;
   }
 
   if (persist_exists(WEATHERFORECAST_PERSIST_KEY)) {
@@ -97,22 +343,35 @@ void Weather_init() {
     persist_read_data(WEATHERFORECAST_PERSIST_KEY, &w, sizeof(WeatherForecastInfo));
 
     Weather_weatherForecast = w;
-
-    Weather_forecastWeatherIcon = gdraw_command_image_create_with_resource(w.forecastIconResourceID);
-
   } else {
     // printf("forecast key does not exist!");
 
-    Weather_forecastWeatherIcon = NULL;
     Weather_weatherForecast.highTemp = INT32_MIN;
     Weather_weatherForecast.lowTemp = INT32_MIN;
+    Weather_weatherForecast.forecastIconResourceID = 0;
+  }
+
+  if (persist_exists(WEATHERHOURLY_PERSIST_KEY) &&
+      persist_get_size(WEATHERHOURLY_PERSIST_KEY) == sizeof(WeatherHourlyForecast)) {
+    persist_read_data(WEATHERHOURLY_PERSIST_KEY, &Weather_hourlyForecast, sizeof(WeatherHourlyForecast));
+
+    // catch up with the time that passed while we weren't running
+    Weather_advanceHourlyForecast(time(NULL));
+  } else {
+    Weather_hourlyForecast.count = 0;
   }
+
+  // the icons themselves are only loaded once the sidebar asks for them
+  Weather_currentWeatherIcon = NULL;
+  Weather_forecastWeatherIcon = NULL;
 }
 
 void Weather_saveData() {
   // printf("saving data!");
-  persist_write_data(WEATHERINFO_PERSIST_KEY, &Weather_weatherInfo, sizeof(WeatherInfo));
-  persist_write_data(WEATHERFORECAST_PERSIST_KEY, &Weather_weatherForecast, sizeof(WeatherForecastInfo));
+  // only the parts that actually changed get written
+  Storage_writeData(WEATHERINFO_PERSIST_KEY, &Weather_weatherInfo, sizeof(WeatherInfo));
+  Storage_writeData(WEATHERFORECAST_PERSIST_KEY, &Weather_weatherForecast, sizeof(WeatherForecastInfo));
+  Storage_writeData(WEATHERHOURLY_PERSIST_KEY, &Weather_hourlyForecast, sizeof(WeatherHourlyForecast));
 }
 
 void Weather_deinit() {
@@ -120,6 +379,10 @@ void Weather_deinit() {
   Weather_saveData();
 
   // free memory
-  gdraw_command_image_destroy(Weather_currentWeatherIcon);
-  gdraw_command_image_destroy(Weather_forecastWeatherIcon);
+  releaseIcon(Weather_currentWeatherIcon);
+  releaseIcon(Weather_forecastWeatherIcon);
+  Weather_currentWeatherIcon = NULL;
+  Weather_forecastWeatherIcon = NULL;
+  Weather_currentIconEnabled = false;
+  Weather_forecastIconEnabled = false;
 }
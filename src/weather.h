@@ -4,6 +4,16 @@
 // persistent storage
 #define WEATHERINFO_PERSIST_KEY 2
 #define WEATHERFORECAST_PERSIST_KEY 222
+#define WEATHERHOURLY_PERSIST_KEY 223
+
+// the number of forecast points kept on the watch
+#define WEATHER_HOURLY_POINTS 16
+
+// ask the phone for new data once the forecast covers less than this
+#define WEATHER_HOURLY_MIN_COVERAGE_HOURS 12
+
+// loaded icons are shared, so there are never more than one per icon shown
+#define WEATHER_ICON_CACHE_SIZE 2
 
 typedef struct {
   int currentTemp;
@@ -16,6 +26,24 @@ typedef struct {
   uint32_t forecastIconResourceID;
 } WeatherForecastInfo;
 
+typedef struct {
+  int8_t temp;        // in degrees C
+  uint8_t condition;  // a WeatherCondition
+} WeatherForecastPoint;
+
+/*
+ * A ring buffer of forecast points, as received from the phone. head is the
+ * point covering startTime, and each point after it covers the next
+ * intervalMinutes. As time passes, head moves forward through the buffer.
+ */
+typedef struct {
+  uint32_t startTime;
+  uint16_t intervalMinutes;
+  uint8_t head;
+  uint8_t count; // the number of points from head onwards that are still valid
+  WeatherForecastPoint points[WEATHER_HOURLY_POINTS];
+} WeatherHourlyForecast;
+
 typedef enum {
   CLEAR_DAY           = 0,
   CLEAR_NIGHT         = 1,
@@ -31,8 +59,18 @@ typedef enum {
   WEATHER_GENERIC     = 11
 } WeatherCondition;
 
+/*
+ * A loaded weather icon, shared by everything showing the same condition
+ */
+typedef struct {
+  uint32_t resourceId;
+  uint8_t refCount;
+  GDrawCommandImage* image;
+} WeatherIconCacheEntry;
+
 extern WeatherInfo Weather_weatherInfo;
 extern WeatherForecastInfo Weather_weatherForecast;
+extern WeatherHourlyForecast Weather_hourlyForecast;
 
 extern GDrawCommandImage* Weather_currentWeatherIcon;
 extern GDrawCommandImage* Weather_forecastWeatherIcon;
@@ -41,5 +79,42 @@ extern GDrawCommandImage* Weather_forecastWeatherIcon;
 void Weather_setCurrentCondition(int conditionCode);
 void Weather_setForecastCondition(int conditionCode);
 void Weather_saveData();
+
+/*
+ * Replaces the hourly forecast with one received from the phone:
+ * [start time, uint32][interval in minutes, uint16][count, uint8], then
+ * [temp, int8][condition, uint8] per point, all little endian
+ */
+void Weather_setHourlyForecast(const uint8_t* data, uint16_t length);
+
+/*
+ * Drops the hourly forecast, for weather from a provider that doesn't have
+ * one: the old points would otherwise overwrite the new weather as time
+ * passes, and keep the watch from asking for more
+ */
+void Weather_clearHourlyForecast();
+
+/*
+ * Moves through the hourly forecast as time passes, updating the current
+ * conditions and today's forecast from it. Returns true if anything changed
+ */
+bool Weather_advanceHourlyForecast(time_t now);
+
+/*
+ * Whether the watch should ask the phone for new weather: true when there's
+ * no hourly forecast, or it's about to run out
+ */
+bool Weather_needsRefresh(time_t now);
+
+/*
+ * Recolors the weather icons if the icon colors have changed
+ */
+void Weather_updateIconColors();
+
+/*
+ * Sets which weather icons are kept in memory. Disabled icons are freed, but
+ * their conditions are still tracked so they can be loaded again later
+ */
+void Weather_setIconsEnabled(bool currentIcon, bool forecastIcon);
 void Weather_init();
 void Weather_deinit();
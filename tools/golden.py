@@ -0,0 +1,196 @@
+# -*- coding: utf-8 -*-
+#
+# Checks the watchface's rendering against the golden images in
+# tools/golden/<platform>/. Build with the golden frames compiled in, then run
+# this for each platform; it installs on the emulator, screenshots every frame
+# and reports the number of differing pixels and the draw time of each:
+#
+#   TIMESTYLE_GOLDEN=1 pebble build
+#   python tools/golden.py check basalt
+#
+# After an intended change to the rendering, record new golden images with:
+#
+#   python tools/golden.py update basalt
+#
+# The golden images should show the rendering of a known good build. To record
+# them from a commit other than the one checked out (which needs the golden
+# frames, so golden.c, in its tree), record builds it in a temporary worktree:
+#
+#   python tools/golden.py record <commit> basalt
+#
+# Each update or record writes the commit and SDK version that made the images
+# to tools/golden/<platform>/SOURCE, and check prints it.
+#
+# Needs the pebble tool on the path, and pypng (which the pebble tool uses for
+# its own screenshots).
+
+from __future__ import print_function
+
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+import png
+
+GOLDEN_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'golden')
+
+# logged by golden.c once each frame has been drawn
+FRAME_PATTERN = re.compile(r'Golden: frame (\d+) (\S+) in (\d+) ms')
+DONE_PATTERN = re.compile(r'Golden: done')
+
+# which build the golden images of a platform came from
+SOURCE_FILE = 'SOURCE'
+
+
+def read_pixels(path):
+    width, height, rows, info = png.Reader(filename=path).asRGBA8()
+    return width, height, [bytearray(row) for row in rows]
+
+
+def count_differences(path, golden_path):
+    """Returns the number of pixels that differ, or None if the sizes do"""
+    width, height, rows = read_pixels(path)
+    golden_width, golden_height, golden_rows = read_pixels(golden_path)
+
+    if (width, height) != (golden_width, golden_height):
+        return None
+
+    differences = 0
+
+    for row, golden_row in zip(rows, golden_rows):
+        for x in range(width):
+            if row[x * 4:x * 4 + 4] != golden_row[x * 4:x * 4 + 4]:
+                differences += 1
+
+    return differences
+
+
+def take_screenshot(platform, path):
+    subprocess.check_call(['pebble', 'screenshot', '--emulator', platform,
+                           '--no-open', '--no-correction', path])
+
+
+def describe_build(app_dir):
+    """The commit (and whether the tree had changes) and SDK that built the app"""
+    commit = subprocess.check_output(['git', 'describe', '--always', '--dirty'],
+                                     cwd=app_dir, universal_newlines=True).strip()
+    sdk = subprocess.check_output(['pebble', '--version'],
+                                  universal_newlines=True).strip()
+
+    return 'commit %s\n%s\n' % (commit, sdk)
+
+
+def run(mode, platform, app_dir=None):
+    platform_dir = os.path.join(GOLDEN_DIR, platform)
+    source_path = os.path.join(platform_dir, SOURCE_FILE)
+
+    if mode == 'check':
+        # without golden images every frame would fail, so don't bother
+        if not os.path.exists(source_path):
+            print('No golden images for %s, record them with: python tools/golden.py update %s' %
+                  (platform, platform))
+            return 1
+
+        with open(source_path) as source:
+            print('Golden images from ' + source.read().replace('\n', ', ').rstrip(', '))
+
+    if mode == 'update':
+        if not os.path.isdir(platform_dir):
+            os.makedirs(platform_dir)
+
+        with open(source_path, 'w') as source:
+            source.write(describe_build(app_dir))
+
+    screenshot_dir = tempfile.mkdtemp()
+
+    # the logs follow the install, so the frames can be caught as they're drawn
+    emulator = subprocess.Popen(['pebble', 'install', '--emulator', platform, '--logs'],
+                                cwd=app_dir, stdout=subprocess.PIPE, universal_newlines=True)
+
+    frames = 0
+    failures = 0
+    total_ms = 0
+
+    try:
+        for line in iter(emulator.stdout.readline, ''):
+            if DONE_PATTERN.search(line):
+                break
+
+            match = FRAME_PATTERN.search(line)
+
+            if not match:
+                continue
+
+            name = match.group(2)
+            draw_ms = int(match.group(3))
+            screenshot = os.path.join(screenshot_dir, name + '.png')
+            golden = os.path.join(platform_dir, name + '.png')
+
+            take_screenshot(platform, screenshot)
+
+            frames += 1
+            total_ms += draw_ms
+
+            if mode == 'update':
+                shutil.copyfile(screenshot, golden)
+                print('%-32s %4d ms  recorded' % (name, draw_ms))
+            elif not os.path.exists(golden):
+                failures += 1
+                print('%-32s %4d ms  no golden image' % (name, draw_ms))
+            else:
+                differences = count_differences(screenshot, golden)
+
+                if differences is None:
+                    failures += 1
+                    print('%-32s %4d ms  wrong size' % (name, draw_ms))
+                elif differences:
+                    failures += 1
+                    print('%-32s %4d ms  %d pixels differ' % (name, draw_ms, differences))
+                else:
+                    print('%-32s %4d ms  ok' % (name, draw_ms))
+    finally:
+        emulator.terminate()
+        shutil.rmtree(screenshot_dir)
+
+    if frames:
+        print('%d frames, %d failed, %.1f ms per frame on average' %
+              (frames, failures, float(total_ms) / frames))
+    else:
+        print('No frames seen, was the app built with TIMESTYLE_GOLDEN=1?')
+        failures = 1
+
+    return 1 if failures else 0
+
+
+def record(commit, platform):
+    """Records the golden images from a build of commit instead of the working tree"""
+    worktree = tempfile.mkdtemp()
+    env = dict(os.environ, TIMESTYLE_GOLDEN='1')
+
+    subprocess.check_call(['git', 'worktree', 'add', '--detach', worktree, commit])
+
+    try:
+        if not os.path.exists(os.path.join(worktree, 'src', 'golden.c')):
+            print('%s has no golden frames to record' % commit)
+            return 1
+
+        subprocess.check_call(['pebble', 'build'], cwd=worktree, env=env)
+
+        return run('update', platform, worktree)
+    finally:
+        subprocess.call(['git', 'worktree', 'remove', '--force', worktree])
+
+
+if __name__ == '__main__':
+    if len(sys.argv) == 4 and sys.argv[1] == 'record':
+        sys.exit(record(sys.argv[2], sys.argv[3]))
+
+    if len(sys.argv) != 3 or sys.argv[1] not in ('check', 'update'):
+        print('usage: python tools/golden.py check|update aplite|basalt|chalk')
+        print('       python tools/golden.py record <commit> aplite|basalt|chalk')
+        sys.exit(2)
+
+    sys.exit(run(sys.argv[1], sys.argv[2]))
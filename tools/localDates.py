@@ -1,6 +1,167 @@
+# -*- coding: utf-8 -*-
+#
+# Prints the day and month abbreviations for some locales, as a starting
+# point for new languages:
+#
+#   python tools/localDates.py
+#
+# and packs the language strings the watch uses into the LANGUAGES resource:
+#
+#   python tools/localDates.py pack resources/data/LANGUAGES.bin
+#
+# Each language is a fixed size record in the same order as the LANGUAGE_*
+# ids in src/languages.h, laid out like LanguageStrings: 7 day names and 12
+# month names of 8 bytes each, then 12 bytes for the word for "week", all
+# null terminated UTF-8.
+
+import io
 import locale
+import struct
+import sys
 import time
 
+DAY_NAME_SIZE = 8
+MONTH_NAME_SIZE = 8
+WEEK_WORD_SIZE = 12
+
+# (day names starting with sunday, month names, word for week)
+# the words for week are taken from:
+# http://www.unicode.org/cldr/charts/28/by_type/date_&_time.fields.html#521165cf49647551
+LANGUAGES = [
+    # EN
+    ([u"SUN", u"MON", u"TUE", u"WED", u"THU", u"FRI", u"SAT"],
+     [u"JAN", u"FEB", u"MAR", u"APR", u"MAY", u"JUN", u"JUL", u"AUG", u"SEP", u"OCT", u"NOV", u"DEC"],
+     u"Wk"),
+    # FR
+    ([u"DIM", u"LUN", u"MAR", u"MER", u"JEU", u"VEN", u"SAM"],
+     [u"JAN", u"FÉV", u"MAR", u"AVR", u"MAI", u"JUI", u"JUL", u"AOÛ", u"SEP", u"OCT", u"NOV", u"DÉC"],
+     u"Sem"),
+    # DE
+    ([u"SO", u"MO", u"DI", u"MI", u"DO", u"FR", u"SA"],
+     [u"JAN", u"FEB", u"MÄR", u"APR", u"MAI", u"JUN", u"JUL", u"AUG", u"SEP", u"OKT", u"NOV", u"DEZ"],
+     u"W"),
+    # ES
+    ([u"DOM", u"LUN", u"MAR", u"MIÉ", u"JUE", u"VIE", u"SÁB"],
+     [u"ENE", u"FEB", u"MAR", u"ABR", u"MAY", u"JUN", u"JUL", u"AGO", u"SEP", u"OCT", u"NOV", u"DIC"],
+     u"Sem"),
+    # IT
+    ([u"DOM", u"LUN", u"MAR", u"MER", u"GIO", u"VEN", u"SAB"],
+     [u"GEN", u"FEB", u"MAR", u"APR", u"MAG", u"GIU", u"LUG", u"AGO", u"SET", u"OTT", u"NOV", u"DIC"],
+     u"Sett"),
+    # NL
+    ([u"ZO", u"MA", u"DI", u"WO", u"DO", u"VR", u"ZA"],
+     [u"JAN", u"FEB", u"MRT", u"APR", u"MEI", u"JUN", u"JUL", u"AUG", u"SEP", u"OKT", u"NOV", u"DEC"],
+     u"Wk"),
+    # TR
+    ([u"PAZ", u"PTS", u"SAL", u"ÇAR", u"PER", u"CUM", u"CTS"],
+     [u"OCA", u"ŞUB", u"MAR", u"NİS", u"MAY", u"HAZ", u"TEM", u"AĞU", u"EYL", u"EKİ", u"KAS", u"ARA"],
+     u"Hf"),
+    # CZ
+    ([u"NE", u"PO", u"ÚT", u"ST", u"ČT", u"PÁ", u"SO"],
+     [u"LED", u"ÚNO", u"BŘE", u"DUB", u"KVĚ", u"ČRV", u"ČVC", u"SRP", u"ZÁŘ", u"ŘÍJ", u"LIS", u"PRO"],
+     u"Týd"),
+    # PT
+    ([u"DOM", u"SEG", u"TER", u"QUA", u"QUI", u"SEX", u"SÁB"],
+     [u"JAN", u"FEV", u"MAR", u"ABR", u"MAI", u"JUN", u"JUL", u"AGO", u"SET", u"OUT", u"NOV", u"DEZ"],
+     u"Sem"),
+    # GK
+    ([u"ΚΥΡ", u"ΔΕΥ", u"ΤΡΙ", u"ΤΕΤ", u"ΠΕΜ", u"ΠΑΡ", u"ΣΑΒ"],
+     [u"ΙΑΝ", u"ΦΕΒ", u"ΜΑΡ", u"ΑΠΡ", u"ΜΑΪ", u"ΙΟΝ", u"ΙΟΛ", u"ΑΥΓ", u"ΣΕΠ", u"ΟΚΤ", u"ΝΟΕ", u"ΔΕΚ"],
+     u"εβδ"),
+    # SE
+    ([u"SÖN", u"MÅN", u"TIS", u"ONS", u"TOR", u"FRE", u"LÖR"],
+     [u"JAN", u"FEB", u"MAR", u"APR", u"MAJ", u"JUN", u"JUL", u"AUG", u"SEP", u"OKT", u"NOV", u"DEC"],
+     u"V"),
+    # PL
+    ([u"NDZ", u"PON", u"WTO", u"ŚRO", u"CZW", u"PIĄ", u"SOB"],
+     [u"STY", u"LUT", u"MAR", u"KWI", u"MAJ", u"CZE", u"LIP", u"SIE", u"WRZ", u"PAŹ", u"LIS", u"GRU"],
+     u"Tydz"),
+    # SK
+    ([u"NE", u"PO", u"UT", u"ST", u"ŠT", u"PI", u"SO"],
+     [u"JAN", u"FEB", u"MAR", u"APR", u"MÁJ", u"JÚN", u"JÚL", u"AUG", u"SEP", u"OKT", u"NOV", u"DEC"],
+     u"Týž"),
+    # VN
+    ([u"CN", u"T2", u"T3", u"T4", u"T5", u"T6", u"T7"],
+     [u"Th1", u"Th2", u"Th3", u"Th4", u"Th5", u"Th6", u"Th7", u"Th8", u"Th9", u"T10", u"T11", u"T12"],
+     u"Tuần"),
+    # RO
+    ([u"DUM", u"LUN", u"MAR", u"MIE", u"JOI", u"VIN", u"SÂM"],
+     [u"IAN", u"FEB", u"MAR", u"APR", u"MAI", u"IUN", u"IUL", u"AUG", u"SEP", u"OCT", u"NOI", u"DEC"],
+     u"Săpt"),
+    # CA
+    ([u"DG", u"DL", u"DT", u"DC", u"DJ", u"DV", u"DS"],
+     [u"GEN", u"FEB", u"MAR", u"ABR", u"MAI", u"JUN", u"JUL", u"AGO", u"SET", u"OCT", u"NOV", u"DES"],
+     u"Setm"),
+    # NO
+    ([u"SØN", u"MAN", u"TIR", u"ONS", u"TOR", u"FRE", u"LØR"],
+     [u"JAN", u"FEB", u"MAR", u"APR", u"MAI", u"JUN", u"JUL", u"AUG", u"SEP", u"OKT", u"NOV", u"DES"],
+     u"Uke"),
+    # RU
+    ([u"ВС", u"ПН", u"ВТ", u"СР", u"ЧТ", u"ПТ", u"СБ"],
+     [u"ЯНВ", u"ФЕВ", u"МАР", u"АПР", u"МАЙ", u"ИЮН", u"ИЮЛ", u"АВГ", u"СЕН", u"ОКТ", u"НОЯ", u"ДЕК"],
+     u"нед"),
+    # EE
+    ([u"P", u"E", u"T", u"K", u"N", u"R", u"L"],
+     [u"JAN", u"VEB", u"MÄR", u"APR", u"MAI", u"JUN", u"JUL", u"AUG", u"SEP", u"OKT", u"NOV", u"DET"],
+     u"Näd"),
+    # EU
+    ([u"IG", u"AL", u"AR", u"AZ", u"OG", u"OL", u"LR"],
+     [u"URT", u"OTS", u"MAR", u"API", u"MAI", u"EKA", u"UZT", u"ABU", u"IRA", u"URR", u"AZA", u"ABE"],
+     u"Ast"),
+    # FI
+    ([u"SU", u"MA", u"TI", u"KE", u"TO", u"PE", u"LA"],
+     [u"TAM", u"HEL", u"MAA", u"HUH", u"TOU", u"KES", u"HEI", u"ELO", u"SYY", u"LOK", u"MAR", u"JOU"],
+     u"Vk"),
+    # DA
+    ([u"SØN", u"MAN", u"TIR", u"ONS", u"TOR", u"FRE", u"LØR"],
+     [u"JAN", u"FEB", u"MAR", u"APR", u"MAJ", u"JUN", u"JUL", u"AUG", u"SEP", u"OKT", u"NOV", u"DEC"],
+     u"Uge"),
+    # LT
+    ([u"SEK", u"PIR", u"ANT", u"TRE", u"KET", u"PEN", u"ŠEŠ"],
+     [u"SAU", u"VAS", u"KOV", u"BAL", u"GEG", u"BIR", u"LIE", u"RUG", u"RGS", u"SPA", u"LAP", u"GRU"],
+     u"Sav"),
+    # SL
+    ([u"NED", u"PON", u"TOR", u"SRE", u"ČET", u"PET", u"SOB"],
+     [u"JAN", u"FEB", u"MAR", u"APR", u"MAJ", u"JUN", u"JUL", u"AVG", u"SEP", u"OKT", u"NOV", u"DEC"],
+     u"Ted"),
+    # HU
+    ([u"VAS", u"HÉT", u"KED", u"SZE", u"CSÜ", u"PÉN", u"SZO"],
+     [u"JAN", u"FEB", u"MÁR", u"ÁPR", u"MÁJ", u"JÚN", u"JÚL", u"AUG", u"SZE", u"OKT", u"NOV", u"DEC"],
+     u"Hét"),
+    # HR
+    ([u"NED", u"PON", u"UTO", u"SRE", u"ČET", u"PET", u"SUB"],
+     [u"SIJ", u"VEL", u"OŽU", u"TRA", u"SVI", u"LIP", u"SRP", u"KOL", u"RUJ", u"LIS", u"STU", u"PRO"],
+     u"Tj"),
+    # GA
+    ([u"DOM", u"LUA", u"MÁI", u"CÉA", u"DÉA", u"AOI", u"SAT"],
+     [u"EAN", u"FEA", u"MÁR", u"AIB", u"BEA", u"MEI", u"IÚI", u"LÚN", u"MFÓ", u"DFÓ", u"SAM", u"NOL"],
+     u"Scht"),
+    # LV
+    ([u"SVĒ", u"PIR", u"OTR", u"TRE", u"CET", u"PIE", u"SES"],
+     [u"JAN", u"FEB", u"MAR", u"APR", u"MAI", u"JŪN", u"JŪL", u"AUG", u"SEP", u"OKT", u"NOV", u"DEC"],
+     u"Ned"),
+    # SR
+    ([u"NE", u"PO", u"UT", u"SR", u"ČE", u"PE", u"SU"],
+     [u"JAN", u"FEB", u"MAR", u"APR", u"MAJ", u"JUN", u"JUL", u"AVG", u"SEP", u"OKT", u"NOV", u"DEC"],
+     u"Ned"),
+    # CN
+    ([u"日", u"一", u"二", u"三", u"四", u"五", u"六"],
+     [u"1", u"2", u"3", u"4", u"5", u"6", u"7", u"8", u"9", u"10", u"11", u"12"],
+     u"周"),
+    # ID
+    ([u"MIN", u"SEN", u"SEL", u"RAB", u"KAM", u"JUM", u"SAB"],
+     [u"JAN", u"FEB", u"MAR", u"APR", u"MEI", u"JUN", u"JUL", u"AGU", u"SEP", u"OKT", u"NOV", u"DES"],
+     u"Ming"),
+    # UK
+    ([u"НД", u"ПН", u"ВТ", u"СР", u"ЧТ", u"ПТ", u"СБ"],
+     [u"СІЧ", u"ЛЮТ", u"БЕР", u"КВІ", u"ТРА", u"ЧЕР", u"ЛИП", u"СЕР", u"ВЕР", u"ЖОВ", u"ЛИС", u"ГРУ"],
+     u"Тиж"),
+    # CY
+    ([u"SUL", u"LLN", u"MAW", u"MER", u"IAU", u"GWE", u"SAD"],
+     [u"ION", u"CHW", u"MAW", u"EBR", u"MAI", u"MEH", u"GOR", u"AWS", u"MED", u"HYD", u"TCH", u"RHA"],
+     u"Wnos"),
+]
+
 locales =  ['en_US',
             'fr_FR',
             'de_DE',
@@ -28,22 +189,55 @@ locales =  ['en_US',
             'hr_HR',
             'lv_LV'];
 
-timeData = list(time.localtime());
-
-for l in locales:
-    print(l)
-    locale.setlocale(locale.LC_ALL, l)
-
-    days = u'{';
-    for i in [6, 0, 1, 2, 3, 4, 5]:
-        timeData[6] = i;
-        days += time.strftime('"%a", ', tuple(timeData)).upper();
-    days += u'}';
-    print(days);
-
-    months = u'{';
-    for i in range(1, 13):
-        timeData[1] = i;
-        months += time.strftime('"%b", ', tuple(timeData)).upper();
-    months += u'}';
-    print(months);
+
+def pack_string(text, size):
+    data = text.encode('utf-8')
+
+    if len(data) >= size:
+        raise ValueError(u'"{}" is too long, the limit is {} bytes'.format(text, size - 1))
+
+    return struct.pack('{}s'.format(size), data)
+
+
+def pack_languages(path):
+    data = b''
+
+    for days, months, week in LANGUAGES:
+        assert len(days) == 7 and len(months) == 12
+
+        data += b''.join(pack_string(day, DAY_NAME_SIZE) for day in days)
+        data += b''.join(pack_string(month, MONTH_NAME_SIZE) for month in months)
+        data += pack_string(week, WEEK_WORD_SIZE)
+
+    with io.open(path, 'wb') as f:
+        f.write(data)
+
+    print('{} languages, {} bytes'.format(len(LANGUAGES), len(data)))
+
+
+def print_locale_dates():
+    timeData = list(time.localtime());
+
+    for l in locales:
+        print(l)
+        locale.setlocale(locale.LC_ALL, l)
+
+        days = u'{';
+        for i in [6, 0, 1, 2, 3, 4, 5]:
+            timeData[6] = i;
+            days += time.strftime('"%a", ', tuple(timeData)).upper();
+        days += u'}';
+        print(days);
+
+        months = u'{';
+        for i in range(1, 13):
+            timeData[1] = i;
+            months += time.strftime('"%b", ', tuple(timeData)).upper();
+        months += u'}';
+        print(months);
+
+
+if len(sys.argv) == 3 and sys.argv[1] == 'pack':
+    pack_languages(sys.argv[2])
+else:
+    print_locale_dates()